@@ -6,6 +6,7 @@
 #include <linux/bug.h>
 #include <linux/completion.h>
 #include <linux/crc-itu-t.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/errno.h>
 #include <linux/firewire.h>
@@ -565,10 +566,16 @@ void fw_card_initialize(struct fw_card *card,
 	card->driver = driver;
 	card->device = device;
 
-	card->transactions.current_tlabel = 0;
-	card->transactions.tlabel_mask = 0;
-	INIT_LIST_HEAD(&card->transactions.list);
-	spin_lock_init(&card->transactions.lock);
+	for (int i = 0; i < ARRAY_SIZE(card->transactions.pools); ++i) {
+		struct fw_transaction_pool *pool = &card->transactions.pools[i];
+
+		spin_lock_init(&pool->lock);
+		pool->current_tlabel = 0;
+		pool->tlabel_mask = 0;
+		memset(pool->by_tlabel, 0, sizeof(pool->by_tlabel));
+		atomic_long_set(&pool->contended, 0);
+	}
+	init_waitqueue_head(&card->transactions.tlabel_wait);
 
 	card->split_timeout.hi = DEFAULT_SPLIT_TIMEOUT / 8000;
 	card->split_timeout.lo = (DEFAULT_SPLIT_TIMEOUT % 8000) << 19;
@@ -597,7 +604,9 @@ int fw_card_add(struct fw_card *card, u32 max_receive, u32 link_speed, u64 guid,
 		unsigned int supported_isoc_contexts)
 {
 	struct workqueue_struct *isoc_wq __free(workqueue_destroy) = NULL;
+	struct workqueue_struct *isoc_percpu_wq __free(workqueue_destroy) = NULL;
 	struct workqueue_struct *async_wq __free(workqueue_destroy) = NULL;
+	char name[16];
 	int ret;
 
 	// This workqueue should be:
@@ -618,6 +627,21 @@ int fw_card_add(struct fw_card *card, u32 max_receive, u32 link_speed, u64 guid,
 	if (!isoc_wq)
 		return -ENOMEM;
 
+	// This workqueue is used for isoc contexts steered to specific CPU, and should be:
+	//  * != WQ_BH			Sleepable.
+	//  * != WQ_UNBOUND		The work item runs on the CPU selected for the context so
+	//				that latency-critical contexts are isolated from the others.
+	//  * != WQ_MEM_RECLAIM		Not used for any backend of block device.
+	//  * == WQ_FREEZABLE		Same as the unbound one.
+	//  * == WQ_HIGHPRI		Same as the unbound one.
+	//  * != WQ_SYSFS		Per-CPU workqueue has no parameter to tune.
+	//  * max_active == n_it + n_ir	Same as the unbound one.
+	isoc_percpu_wq = alloc_workqueue("firewire-isoc-percpu-card%u",
+					 WQ_PERCPU | WQ_FREEZABLE | WQ_HIGHPRI,
+					 supported_isoc_contexts, card->index);
+	if (!isoc_percpu_wq)
+		return -ENOMEM;
+
 	// This workqueue should be:
 	//  * != WQ_BH			Sleepable.
 	//  * == WQ_UNBOUND		Any core can process data for asynchronous context.
@@ -634,7 +658,12 @@ int fw_card_add(struct fw_card *card, u32 max_receive, u32 link_speed, u64 guid,
 		return -ENOMEM;
 
 	card->isoc_wq = isoc_wq;
+	card->isoc_percpu_wq = isoc_percpu_wq;
 	card->async_wq = async_wq;
+	// Failure of debugfs is not fatal. The error pointer is just ignored by the other APIs.
+	snprintf(name, sizeof(name), "fw%u", card->index);
+	card->debugfs_dir = debugfs_create_dir(name, fw_debugfs_root);
+	fw_transactions_debugfs_init(card);
 	card->max_receive = max_receive;
 	card->link_speed = link_speed;
 	card->guid = guid;
@@ -643,11 +672,15 @@ int fw_card_add(struct fw_card *card, u32 max_receive, u32 link_speed, u64 guid,
 		generate_config_rom(card, tmp_config_rom);
 		ret = card->driver->enable(card, tmp_config_rom, config_rom_length);
 		if (ret < 0) {
+			debugfs_remove_recursive(card->debugfs_dir);
+			card->debugfs_dir = NULL;
 			card->isoc_wq = NULL;
+			card->isoc_percpu_wq = NULL;
 			card->async_wq = NULL;
 			return ret;
 		}
 		retain_and_null_ptr(isoc_wq);
+		retain_and_null_ptr(isoc_percpu_wq);
 		retain_and_null_ptr(async_wq);
 
 		list_add_tail(&card->link, &card_list);
@@ -686,6 +719,16 @@ static void dummy_send_request(struct fw_card *card, struct fw_packet *packet)
 	packet->callback(packet, card, RCODE_CANCELLED);
 }
 
+static void dummy_send_requests(struct fw_card *card, struct list_head *packets)
+{
+	struct fw_packet *packet, *next;
+
+	list_for_each_entry_safe(packet, next, packets, link) {
+		list_del_init(&packet->link);
+		packet->callback(packet, card, RCODE_CANCELLED);
+	}
+}
+
 static void dummy_send_response(struct fw_card *card, struct fw_packet *packet)
 {
 	packet->callback(packet, card, RCODE_CANCELLED);
@@ -696,6 +739,12 @@ static int dummy_cancel_packet(struct fw_card *card, struct fw_packet *packet)
 	return -ENOENT;
 }
 
+static void *dummy_lend_payload(struct fw_card *card, const struct fw_packet *packet,
+				unsigned long *lease)
+{
+	return NULL;
+}
+
 static int dummy_enable_phys_dma(struct fw_card *card,
 				 int node_id, int generation)
 {
@@ -717,6 +766,30 @@ static void dummy_write_csr(struct fw_card *card, int csr_offset, u32 value)
 {
 }
 
+static u32 dummy_estimate_cycle_time(struct fw_card *card)
+{
+	return 0;
+}
+
+static int dummy_reserve_iso_descriptors(struct fw_iso_context *ctx, unsigned int packets,
+					 size_t header_length, size_t payload_length)
+{
+	return -ENODEV;
+}
+
+static int dummy_create_iso_ring_program(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+					 unsigned int slots, unsigned int slot_size,
+					 unsigned int irq_interval, int tag)
+{
+	return -ENODEV;
+}
+
+static int dummy_update_iso_ring_slot(struct fw_iso_context *ctx, unsigned int index,
+				      unsigned int length)
+{
+	return -ENODEV;
+}
+
 static int dummy_start_iso(struct fw_iso_context *ctx,
 			   s32 cycle, u32 sync, u32 tags)
 {
@@ -747,12 +820,18 @@ static const struct fw_card_driver dummy_driver_template = {
 	.read_phy_reg		= dummy_read_phy_reg,
 	.update_phy_reg		= dummy_update_phy_reg,
 	.send_request		= dummy_send_request,
+	.send_requests		= dummy_send_requests,
 	.send_response		= dummy_send_response,
 	.cancel_packet		= dummy_cancel_packet,
+	.lend_payload		= dummy_lend_payload,
 	.enable_phys_dma	= dummy_enable_phys_dma,
 	.read_csr		= dummy_read_csr,
 	.write_csr		= dummy_write_csr,
+	.estimate_cycle_time	= dummy_estimate_cycle_time,
 	.allocate_iso_context	= dummy_allocate_iso_context,
+	.reserve_iso_descriptors = dummy_reserve_iso_descriptors,
+	.create_iso_ring_program = dummy_create_iso_ring_program,
+	.update_iso_ring_slot	= dummy_update_iso_ring_slot,
 	.start_iso		= dummy_start_iso,
 	.set_iso_channels	= dummy_set_iso_channels,
 	.queue_iso		= dummy_queue_iso,
@@ -784,10 +863,12 @@ void fw_core_remove_card(struct fw_card *card)
 	/* Switch off most of the card driver interface. */
 	dummy_driver.free_iso_context	= card->driver->free_iso_context;
 	dummy_driver.stop_iso		= card->driver->stop_iso;
+	dummy_driver.return_payload	= card->driver->return_payload;
 	dummy_driver.disable		= card->driver->disable;
 	card->driver = &dummy_driver;
 
 	drain_workqueue(card->isoc_wq);
+	drain_workqueue(card->isoc_percpu_wq);
 	drain_workqueue(card->async_wq);
 	card->driver->disable(card);
 	fw_cancel_pending_transactions(card);
@@ -795,23 +876,58 @@ void fw_core_remove_card(struct fw_card *card)
 	scoped_guard(spinlock_irqsave, &card->lock)
 		fw_destroy_nodes(card);
 
+	debugfs_remove_recursive(card->debugfs_dir);
+	card->debugfs_dir = NULL;
+
 	/* Wait for all users, especially device workqueue jobs, to finish. */
 	fw_card_put(card);
 	wait_for_completion(&card->done);
 
 	destroy_workqueue(card->isoc_wq);
+	destroy_workqueue(card->isoc_percpu_wq);
 	destroy_workqueue(card->async_wq);
 
-	WARN_ON(!list_empty(&card->transactions.list));
+	WARN_ON(fw_has_pending_transactions(card));
 }
 EXPORT_SYMBOL(fw_core_remove_card);
 
 /**
- * fw_card_read_cycle_time: read from Isochronous Cycle Timer Register of 1394 OHCI in MMIO region
+ * fw_card_read_cycle_time: estimate the value of Isochronous Cycle Timer Register of 1394 OHCI
  *			    for controller card.
  * @card: The instance of card for 1394 OHCI controller.
  * @cycle_time: The mutual reference to value of cycle time for the read operation.
  *
+ * Estimate the current value of Isochronous Cycle Timer Register of 1394 OHCI for the given
+ * controller card, by extrapolating the recent value of the register with the elapsed system
+ * time. The register in MMIO region is read only when the recent value is not available or too
+ * old. The error of estimation is within a few ticks of 24.576 MHz clock. Use
+ * fw_card_read_cycle_time_precise() to correlate the cycle time with system time.
+ * When returning successfully, the content of @value argument has value aligned to host endianness,
+ * formetted by CYCLE_TIME CSR Register of IEEE 1394 std.
+ *
+ * Context: Any context.
+ * Return:
+ * * 0 - Read successfully.
+ * * -ENODEV - The controller is unavailable due to being removed or unbound.
+ */
+int fw_card_read_cycle_time(struct fw_card *card, u32 *cycle_time)
+{
+	if (card->driver->read_csr == dummy_read_csr)
+		return -ENODEV;
+
+	// It's possible to switch to dummy driver between the above and the below. This is the best
+	// effort to return -ENODEV.
+	*cycle_time = card->driver->estimate_cycle_time(card);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(fw_card_read_cycle_time);
+
+/**
+ * fw_card_read_cycle_time_precise: read from Isochronous Cycle Timer Register of 1394 OHCI in MMIO
+ *				    region for controller card.
+ * @card: The instance of card for 1394 OHCI controller.
+ * @cycle_time: The mutual reference to value of cycle time for the read operation.
+ *
  * Read value from Isochronous Cycle Timer Register of 1394 OHCI in MMIO region for the given
  * controller card. This function accesses the region without any lock primitives or IRQ mask.
  * When returning successfully, the content of @value argument has value aligned to host endianness,
@@ -822,7 +938,7 @@ EXPORT_SYMBOL(fw_core_remove_card);
  * * 0 - Read successfully.
  * * -ENODEV - The controller is unavailable due to being removed or unbound.
  */
-int fw_card_read_cycle_time(struct fw_card *card, u32 *cycle_time)
+int fw_card_read_cycle_time_precise(struct fw_card *card, u32 *cycle_time)
 {
 	if (card->driver->read_csr == dummy_read_csr)
 		return -ENODEV;
@@ -832,4 +948,4 @@ int fw_card_read_cycle_time(struct fw_card *card, u32 *cycle_time)
 	*cycle_time = card->driver->read_csr(card, CSR_CYCLE_TIME);
 	return 0;
 }
-EXPORT_SYMBOL_GPL(fw_card_read_cycle_time);
+EXPORT_SYMBOL_GPL(fw_card_read_cycle_time_precise);
@@ -7,6 +7,7 @@
 
 #include <linux/bug.h>
 #include <linux/compat.h>
+#include <linux/completion.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/dma-mapping.h>
@@ -18,11 +19,13 @@
 #include <linux/jiffies.h>
 #include <linux/kernel.h>
 #include <linux/kref.h>
+#include <linux/log2.h>
 #include <linux/mm.h>
 #include <linux/module.h>
 #include <linux/mutex.h>
 #include <linux/poll.h>
 #include <linux/sched.h> /* required for linux/wait.h */
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
@@ -41,15 +44,54 @@
 /*
  * ABI version history is documented in linux/firewire-cdev.h.
  */
-#define FW_CDEV_KERNEL_VERSION			6
+#define FW_CDEV_KERNEL_VERSION			7
 #define FW_CDEV_VERSION_EVENT_REQUEST2		4
 #define FW_CDEV_VERSION_ALLOCATE_REGION_END	4
 #define FW_CDEV_VERSION_AUTO_FLUSH_ISO_OVERFLOW	5
 #define FW_CDEV_VERSION_EVENT_ASYNC_TSTAMP	6
+#define FW_CDEV_VERSION_BATCHED_READ		7
+#define FW_CDEV_VERSION_ISO_POLLING		7
+#define FW_CDEV_VERSION_MULTIPLE_ISO_CONTEXTS	7
 
 static DEFINE_SPINLOCK(phy_receiver_list_lock);
 static LIST_HEAD(phy_receiver_list);
 
+// The offset of mmap(2) to map the ring buffer of events, distinguished from the isochronous
+// buffer mapped at any offset below it.
+#define EVENT_RING_MMAP_OFFSET	0x40000000UL
+#define EVENT_RING_MIN_SIZE	SZ_4K
+#define EVENT_RING_MAX_SIZE	SZ_16M
+
+// The maximum number of isochronous contexts per client. The isochronous buffer for the context
+// is mapped at the offset of mmap(2) computed by its handle.
+#define ISO_CONTEXT_SLOTS	64
+static_assert(ISO_CONTEXT_SLOTS * FW_CDEV_ISO_BUFFER_MMAP_STRIDE <= EVENT_RING_MMAP_OFFSET);
+
+// The ring buffer of events shared with user space. The header and the data area are in the
+// vmalloc'ed area, while the fields of this structure are private to the kernel so that user
+// space can not corrupt them.
+struct event_ring {
+	struct fw_cdev_event_ring_header *header;
+	u8 *data;
+	u32 size;
+	u32 data_offset;
+	u32 head;
+	u32 overflow;
+};
+
+struct client;
+
+// The isochronous context and the buffer for it, identified by the handle. The structure is
+// allocated at the creation of context or the mapping of buffer, and released together with the
+// client.
+struct iso_client_context {
+	struct client *client;
+	struct fw_iso_context *context;
+	u64 closure;
+	struct fw_iso_buffer buffer;
+	unsigned long vm_start;
+};
+
 struct client {
 	u32 version;
 	struct fw_device *device;
@@ -58,15 +100,14 @@ struct client {
 	bool in_shutdown;
 	struct xarray resource_xa;
 	struct list_head event_list;
+	struct event_ring *event_ring;
 	wait_queue_head_t wait;
 	wait_queue_head_t tx_flush_wait;
 	u64 bus_reset_closure;
 
-	struct fw_iso_context *iso_context;
+	// Indexed by the handle of isochronous context.
+	struct iso_client_context *iso_contexts[ISO_CONTEXT_SLOTS];
 	struct mutex iso_context_mutex;
-	u64 iso_closure;
-	struct fw_iso_buffer buffer;
-	unsigned long vm_start;
 
 	struct list_head phy_receiver_link;
 	u64 phy_receiver_closure;
@@ -331,6 +372,56 @@ static int fw_device_op_open(struct inode *inode, struct file *file)
 	return nonseekable_open(inode, file);
 }
 
+// client->lock must be acquired in advance.
+static bool write_event_to_ring(struct event_ring *ring, const struct event *event)
+{
+	size_t length = event->v[0].size + event->v[1].size;
+	struct fw_cdev_event_ring_entry *entry;
+	u32 tail, used, offset, contiguous, record, required;
+
+	// Paired with the release of tail by user space, so that the records are not overwritten
+	// before consumed.
+	tail = smp_load_acquire(&ring->header->tail);
+	used = ring->head - tail;
+	// The tail is corrupted by user space. The events are queued for read(2) instead.
+	if (used > ring->size)
+		return false;
+
+	if (length > ring->size)
+		return false;
+	record = sizeof(*entry) + ALIGN(length, sizeof(*entry));
+
+	offset = ring->head & (ring->size - 1);
+	contiguous = ring->size - offset;
+	required = record;
+	if (contiguous < record)
+		required += contiguous;
+	if (ring->size - used < required)
+		return false;
+
+	// The record is not split at the end of the data area.
+	if (contiguous < record) {
+		entry = (struct fw_cdev_event_ring_entry *)(ring->data + offset);
+		entry->length = contiguous - sizeof(*entry);
+		entry->flags = FW_CDEV_EVENT_RING_ENTRY_PADDING;
+		ring->head += contiguous;
+		offset = 0;
+	}
+
+	entry = (struct fw_cdev_event_ring_entry *)(ring->data + offset);
+	entry->length = length;
+	entry->flags = 0;
+	memcpy(entry->data, event->v[0].data, event->v[0].size);
+	if (event->v[1].size > 0)
+		memcpy((u8 *)entry->data + event->v[0].size, event->v[1].data, event->v[1].size);
+	ring->head += record;
+
+	// Paired with the acquire of head by user space, so that the records are visible.
+	smp_store_release(&ring->header->head, ring->head);
+
+	return true;
+}
+
 static void queue_event(struct client *client, struct event *event,
 			void *data0, size_t size0, void *data1, size_t size1)
 {
@@ -340,10 +431,20 @@ static void queue_event(struct client *client, struct event *event,
 	event->v[1].size = size1;
 
 	scoped_guard(spinlock_irqsave, &client->lock) {
-		if (client->in_shutdown)
+		struct event_ring *ring = client->event_ring;
+
+		if (client->in_shutdown) {
 			kfree(event);
-		else
+		} else if (!ring) {
 			list_add_tail(&event->link, &client->event_list);
+		} else if (list_empty(&client->event_list) && write_event_to_ring(ring, event)) {
+			kfree(event);
+		} else {
+			// The events are delivered by read(2) until the queue becomes empty, to keep
+			// the order of events.
+			list_add_tail(&event->link, &client->event_list);
+			WRITE_ONCE(ring->header->overflow, ++ring->overflow);
+		}
 	}
 
 	wake_up_interruptible(&client->wait);
@@ -388,12 +489,101 @@ static int dequeue_event(struct client *client,
 	return ret;
 }
 
+static size_t event_length(const struct event *event)
+{
+	return event->v[0].size + event->v[1].size;
+}
+
+static size_t event_record_size(const struct event *event)
+{
+	return sizeof(struct fw_cdev_event_ring_entry) +
+	       ALIGN(event_length(event), sizeof(struct fw_cdev_event_ring_entry));
+}
+
+// Copy as many whole events as fit in the buffer, each of which is prefixed by the header of
+// record. The first event is truncated if the buffer is not enough for it.
+static ssize_t dequeue_events(struct client *client, char __user *buffer, size_t count)
+{
+	struct fw_cdev_event_ring_entry entry = {0};
+	struct event *event, *next;
+	LIST_HEAD(events);
+	size_t total;
+	int i, ret;
+
+	if (count < sizeof(entry))
+		return -EINVAL;
+
+	ret = wait_event_interruptible(client->wait,
+			!list_empty(&client->event_list) ||
+			fw_device_is_shutdown(client->device));
+	if (ret < 0)
+		return ret;
+
+	if (list_empty(&client->event_list) &&
+		       fw_device_is_shutdown(client->device))
+		return -ENODEV;
+
+	total = 0;
+	scoped_guard(spinlock_irq, &client->lock) {
+		list_for_each_entry_safe(event, next, &client->event_list, link) {
+			size_t size = event_record_size(event);
+
+			if (total + size > count && !list_empty(&events))
+				break;
+			list_move_tail(&event->link, &events);
+			total += size;
+		}
+	}
+
+	total = 0;
+	list_for_each_entry_safe(event, next, &events, link) {
+		size_t length = min(event_length(event), count - total - sizeof(entry));
+		size_t offset = total + sizeof(entry);
+		bool faulted;
+
+		entry.length = length;
+		faulted = copy_to_user(buffer + total, &entry, sizeof(entry));
+
+		for (i = 0; i < ARRAY_SIZE(event->v) && !faulted && length > 0; i++) {
+			size_t size = min(event->v[i].size, length);
+
+			faulted = copy_to_user(buffer + offset, event->v[i].data, size);
+			offset += size;
+			length -= size;
+		}
+
+		if (faulted)
+			break;
+
+		// The padding of the last record is not included.
+		ret = offset;
+		total = min(ALIGN(offset, sizeof(entry)), count);
+
+		list_del(&event->link);
+		kfree(event);
+	}
+
+	// The events from the one failed to be copied are put back to the head of list, so that
+	// they are available in the next call.
+	if (!list_empty(&events)) {
+		scoped_guard(spinlock_irq, &client->lock)
+			list_splice(&events, &client->event_list);
+		if (ret == 0)
+			ret = -EFAULT;
+	}
+
+	return ret;
+}
+
 static ssize_t fw_device_op_read(struct file *file, char __user *buffer,
 				 size_t count, loff_t *offset)
 {
 	struct client *client = file->private_data;
 
-	return dequeue_event(client, buffer, count);
+	if (client->version >= FW_CDEV_VERSION_BATCHED_READ)
+		return dequeue_events(client, buffer, count);
+	else
+		return dequeue_event(client, buffer, count);
 }
 
 static void fill_bus_reset_event(struct fw_cdev_event_bus_reset *event,
@@ -483,6 +673,9 @@ union ioctl_arg {
 	struct fw_cdev_receive_phy_packets	receive_phy_packets;
 	struct fw_cdev_set_iso_channels		set_iso_channels;
 	struct fw_cdev_flush_iso		flush_iso;
+	struct fw_cdev_setup_event_ring		setup_event_ring;
+	struct fw_cdev_send_requests		send_requests;
+	struct fw_cdev_run_transaction		run_transaction;
 };
 
 static int ioctl_get_info(struct client *client, union ioctl_arg *arg)
@@ -645,9 +838,10 @@ static void complete_transaction(struct fw_card *card, int rcode, u32 request_ts
 	client_put(client);
 }
 
-static int init_request(struct client *client,
-			struct fw_cdev_send_request *request,
-			int destination_id, int speed)
+// Allocate the event for the response, with the payload of request copied from user space. It is
+// registered as the resource of client.
+static struct outbound_transaction_event *prepare_outbound_transaction(struct client *client,
+					struct fw_cdev_send_request *request, int speed)
 {
 	struct outbound_transaction_event *e;
 	void *payload;
@@ -655,15 +849,15 @@ static int init_request(struct client *client,
 
 	if (request->tcode != TCODE_STREAM_DATA &&
 	    (request->length > 4096 || request->length > 512 << speed))
-		return -EIO;
+		return ERR_PTR(-EIO);
 
 	if (request->tcode == TCODE_WRITE_QUADLET_REQUEST &&
 	    request->length < 4)
-		return -EINVAL;
+		return ERR_PTR(-EINVAL);
 
 	e = kmalloc(sizeof(*e) + request->length, GFP_KERNEL);
 	if (e == NULL)
-		return -ENOMEM;
+		return ERR_PTR(-ENOMEM);
 	e->client = client;
 
 	if (client->version < FW_CDEV_VERSION_EVENT_ASYNC_TSTAMP) {
@@ -692,20 +886,42 @@ static int init_request(struct client *client,
 	if (ret < 0)
 		goto failed;
 
-	fw_send_request_with_tstamp(client->device->card, &e->r.transaction, request->tcode,
-				    destination_id, request->generation, speed, request->offset,
-				    payload, request->length, complete_transaction, e);
-	return 0;
+	return e;
 
  failed:
 	kfree(e);
 
-	return ret;
+	return ERR_PTR(ret);
 }
 
-static int ioctl_send_request(struct client *client, union ioctl_arg *arg)
+static void *outbound_transaction_payload(struct outbound_transaction_event *e)
+{
+	if (e->rsp.without_tstamp.type == FW_CDEV_EVENT_RESPONSE)
+		return e->rsp.without_tstamp.data;
+	else
+		return e->rsp.with_tstamp.data;
+}
+
+static int init_request(struct client *client,
+			struct fw_cdev_send_request *request,
+			int destination_id, int speed)
+{
+	struct outbound_transaction_event *e;
+
+	e = prepare_outbound_transaction(client, request, speed);
+	if (IS_ERR(e))
+		return PTR_ERR(e);
+
+	fw_send_request_with_tstamp(client->device->card, &e->r.transaction, request->tcode,
+				    destination_id, request->generation, speed, request->offset,
+				    outbound_transaction_payload(e), request->length,
+				    complete_transaction, e);
+	return 0;
+}
+
+static bool is_valid_request_tcode(int tcode)
 {
-	switch (arg->send_request.tcode) {
+	switch (tcode) {
 	case TCODE_WRITE_QUADLET_REQUEST:
 	case TCODE_WRITE_BLOCK_REQUEST:
 	case TCODE_READ_QUADLET_REQUEST:
@@ -717,15 +933,196 @@ static int ioctl_send_request(struct client *client, union ioctl_arg *arg)
 	case TCODE_LOCK_BOUNDED_ADD:
 	case TCODE_LOCK_WRAP_ADD:
 	case TCODE_LOCK_VENDOR_DEPENDENT:
-		break;
+		return true;
 	default:
-		return -EINVAL;
+		return false;
 	}
+}
+
+static int ioctl_send_request(struct client *client, union ioctl_arg *arg)
+{
+	if (!is_valid_request_tcode(arg->send_request.tcode))
+		return -EINVAL;
 
 	return init_request(client, &arg->send_request, client->device->node_id,
 			    client->device->max_speed);
 }
 
+// The maximum number of requests prepared before queueing them. Any request more than the number
+// of tlabels can not be outstanding at the same time anyway.
+#define SEND_REQUESTS_CHUNK	32
+
+struct prepared_request {
+	struct fw_cdev_send_request request;
+	struct outbound_transaction_event *event;
+};
+
+static int ioctl_send_requests(struct client *client, union ioctl_arg *arg)
+{
+	struct fw_cdev_send_requests *a = &arg->send_requests;
+	struct prepared_request *chunk __free(kfree) = NULL;
+	struct fw_card *card = client->device->card;
+	int destination_id = client->device->node_id;
+	int speed = client->device->max_speed;
+	u8 __user *ptr = u64_to_uptr(a->requests);
+	unsigned int count = 0;
+	int ret = 0;
+
+	if (a->stride < offsetofend(struct fw_cdev_send_request, generation))
+		return -EINVAL;
+	if (a->count == 0)
+		return 0;
+
+	chunk = kmalloc_objs(*chunk, min(a->count, SEND_REQUESTS_CHUNK));
+	if (!chunk)
+		return -ENOMEM;
+
+	while (count < a->count && ret == 0) {
+		unsigned int prepared, queued;
+		LIST_HEAD(packets);
+
+		// Everything sleepable is done before queueing the requests, since the transactions
+		// are visible to the response and the bus reset handling once queued.
+		for (prepared = 0; prepared < min(a->count - count, SEND_REQUESTS_CHUNK); ++prepared) {
+			struct fw_cdev_send_request *request = &chunk[prepared].request;
+			struct outbound_transaction_event *e;
+
+			memset(request, 0, sizeof(*request));
+			if (copy_from_user(request, ptr + (size_t)(count + prepared) * a->stride,
+					   min_t(size_t, a->stride, sizeof(*request)))) {
+				ret = -EFAULT;
+				break;
+			}
+			if (!is_valid_request_tcode(request->tcode)) {
+				ret = -EINVAL;
+				break;
+			}
+
+			e = prepare_outbound_transaction(client, request, speed);
+			if (IS_ERR(e)) {
+				ret = PTR_ERR(e);
+				break;
+			}
+			chunk[prepared].event = e;
+		}
+
+		for (queued = 0; queued < prepared; ++queued) {
+			struct fw_cdev_send_request *request = &chunk[queued].request;
+			struct outbound_transaction_event *e = chunk[queued].event;
+
+			if (fw_queue_request_with_tstamp(card, &e->r.transaction, request->tcode,
+							 destination_id, request->generation, speed,
+							 request->offset,
+							 outbound_transaction_payload(e),
+							 request->length, complete_transaction, e,
+							 &packets) < 0) {
+				ret = -EAGAIN;
+				break;
+			}
+		}
+
+		fw_send_queued_requests(card, &packets);
+		count += queued;
+
+		// No tlabel is available for the rest.
+		for (; queued < prepared; ++queued) {
+			struct outbound_transaction_event *e = chunk[queued].event;
+
+			release_client_resource(client, e->r.resource.handle, release_transaction,
+						NULL);
+			kfree(e);
+		}
+	}
+
+	if (count == 0 && ret < 0)
+		return ret;
+
+	a->requests += (u64)count * a->stride;
+	a->count -= count;
+
+	return count;
+}
+
+struct sync_transaction {
+	struct completion done;
+	void *payload;
+	size_t length;
+	int rcode;
+	u32 request_tstamp;
+	u32 response_tstamp;
+};
+
+static void complete_sync_transaction(struct fw_card *card, int rcode, u32 request_tstamp,
+				      u32 response_tstamp, void *payload, size_t length, void *data)
+{
+	struct sync_transaction *st = data;
+
+	if (rcode == RCODE_COMPLETE) {
+		st->length = min(st->length, length);
+		memcpy(st->payload, payload, st->length);
+	} else {
+		st->length = 0;
+	}
+	st->rcode = rcode;
+	st->request_tstamp = request_tstamp;
+	st->response_tstamp = response_tstamp;
+
+	complete(&st->done);
+}
+
+static int ioctl_run_transaction(struct client *client, union ioctl_arg *arg)
+{
+	struct fw_cdev_run_transaction *a = &arg->run_transaction;
+	struct fw_card *card = client->device->card;
+	void *heap_payload __free(kfree) = NULL;
+	struct sync_transaction st;
+	struct fw_transaction t;
+	u8 stack_payload[8];
+	void *payload;
+
+	if (!is_valid_request_tcode(a->tcode))
+		return -EINVAL;
+
+	if (a->length > sizeof(a->data) ||
+	    (a->tcode == TCODE_WRITE_QUADLET_REQUEST && a->length < 4))
+		return -EINVAL;
+
+	// The payload of request is not mapped for DMA if it is small enough to be copied into the
+	// descriptor by the driver. If not, it should not be on the stack.
+	if (a->length <= sizeof(stack_payload)) {
+		memcpy(stack_payload, a->data, a->length);
+		payload = stack_payload;
+	} else {
+		heap_payload = kmemdup(a->data, a->length, GFP_KERNEL);
+		if (!heap_payload)
+			return -ENOMEM;
+		payload = heap_payload;
+	}
+
+	init_completion(&st.done);
+	st.payload = a->data;
+	st.length = sizeof(a->data);
+
+	timer_setup_on_stack(&t.split_timeout_timer, NULL, 0);
+	fw_send_request_with_tstamp(card, &t, a->tcode, client->device->node_id, a->generation,
+				    client->device->max_speed, a->offset, payload, a->length,
+				    complete_sync_transaction, &st);
+	// The callback is surely called after the cancellation, or by the completion or the split
+	// timeout of transaction if it is too late to cancel.
+	if (wait_for_completion_killable(&st.done) < 0) {
+		fw_cancel_transaction(card, &t);
+		wait_for_completion(&st.done);
+	}
+	timer_destroy_on_stack(&t.split_timeout_timer);
+
+	a->rcode = st.rcode;
+	a->length = st.length;
+	a->request_tstamp = st.request_tstamp;
+	a->response_tstamp = st.response_tstamp;
+
+	return 0;
+}
+
 static void release_request(struct client *client,
 			    struct client_resource *resource)
 {
@@ -999,7 +1396,8 @@ static int ioctl_remove_descriptor(struct client *client, union ioctl_arg *arg)
 static void iso_callback(struct fw_iso_context *context, u32 cycle,
 			 size_t header_length, void *header, void *data)
 {
-	struct client *client = data;
+	struct iso_client_context *ic = data;
+	struct client *client = ic->client;
 	struct iso_interrupt_event *e;
 
 	e = kmalloc(sizeof(*e) + header_length, GFP_KERNEL);
@@ -1007,7 +1405,7 @@ static void iso_callback(struct fw_iso_context *context, u32 cycle,
 		return;
 
 	e->interrupt.type      = FW_CDEV_EVENT_ISO_INTERRUPT;
-	e->interrupt.closure   = client->iso_closure;
+	e->interrupt.closure   = ic->closure;
 	e->interrupt.cycle     = cycle;
 	e->interrupt.header_length = header_length;
 	memcpy(e->interrupt.header, header, header_length);
@@ -1018,7 +1416,8 @@ static void iso_callback(struct fw_iso_context *context, u32 cycle,
 static void iso_mc_callback(struct fw_iso_context *context,
 			    dma_addr_t completed, void *data)
 {
-	struct client *client = data;
+	struct iso_client_context *ic = data;
+	struct client *client = ic->client;
 	struct iso_interrupt_mc_event *e;
 
 	e = kmalloc_obj(*e);
@@ -1026,8 +1425,8 @@ static void iso_mc_callback(struct fw_iso_context *context,
 		return;
 
 	e->interrupt.type      = FW_CDEV_EVENT_ISO_INTERRUPT_MULTICHANNEL;
-	e->interrupt.closure   = client->iso_closure;
-	e->interrupt.completed = fw_iso_buffer_lookup(&client->buffer,
+	e->interrupt.closure   = ic->closure;
+	e->interrupt.completed = fw_iso_buffer_lookup(&ic->buffer,
 						      completed);
 	queue_event(client, &e->event, &e->interrupt,
 		    sizeof(e->interrupt), NULL, 0);
@@ -1041,10 +1440,51 @@ static enum dma_data_direction iso_dma_direction(struct fw_iso_context *context)
 			return DMA_FROM_DEVICE;
 }
 
+// client->iso_context_mutex must be acquired in advance.
+static struct iso_client_context *get_iso_client_context(struct client *client,
+							 unsigned int handle)
+{
+	struct iso_client_context *ic = client->iso_contexts[handle];
+
+	lockdep_assert_held(&client->iso_context_mutex);
+
+	if (!ic) {
+		ic = kzalloc_obj(*ic);
+		if (!ic)
+			return NULL;
+		ic->client = client;
+		client->iso_contexts[handle] = ic;
+	}
+
+	return ic;
+}
+
+// The returned structure is available without the mutex, since neither it nor the context is
+// released until the client is released.
+static struct iso_client_context *lookup_iso_client_context(struct client *client, u32 handle)
+{
+	struct iso_client_context *ic;
+
+	if (handle >= ISO_CONTEXT_SLOTS)
+		return NULL;
+
+	guard(mutex)(&client->iso_context_mutex);
+
+	ic = client->iso_contexts[handle];
+	if (!ic || !ic->context)
+		return NULL;
+
+	return ic;
+}
+
 static int ioctl_create_iso_context(struct client *client, union ioctl_arg *arg)
 {
 	struct fw_cdev_create_iso_context *a = &arg->create_iso_context;
+	struct iso_client_context *ic;
 	struct fw_iso_context *context;
+	bool polling = a->type & FW_CDEV_ISO_CONTEXT_POLLING;
+	u32 type = a->type & ~FW_CDEV_ISO_CONTEXT_POLLING;
+	unsigned int handle, slots;
 	int ret;
 
 	BUILD_BUG_ON(FW_CDEV_ISO_CONTEXT_TRANSMIT != FW_ISO_CONTEXT_TRANSMIT ||
@@ -1052,7 +1492,10 @@ static int ioctl_create_iso_context(struct client *client, union ioctl_arg *arg)
 		     FW_CDEV_ISO_CONTEXT_RECEIVE_MULTICHANNEL !=
 					FW_ISO_CONTEXT_RECEIVE_MULTICHANNEL);
 
-	switch (a->type) {
+	if (polling && client->version < FW_CDEV_VERSION_ISO_POLLING)
+		return -EINVAL;
+
+	switch (type) {
 	case FW_ISO_CONTEXT_TRANSMIT:
 		if (a->speed > SCODE_3200 || a->channel > 63)
 			return -EINVAL;
@@ -1071,39 +1514,55 @@ static int ioctl_create_iso_context(struct client *client, union ioctl_arg *arg)
 		return -EINVAL;
 	}
 
-	if (a->type == FW_ISO_CONTEXT_RECEIVE_MULTICHANNEL)
-		context = fw_iso_mc_context_create(client->device->card, iso_mc_callback, client);
+	// The former clients are allowed to create the single context.
+	if (client->version < FW_CDEV_VERSION_MULTIPLE_ISO_CONTEXTS)
+		slots = 1;
+	else
+		slots = ISO_CONTEXT_SLOTS;
+
+	guard(mutex)(&client->iso_context_mutex);
+
+	// The lowest handle of which the context is not created yet, so that the buffer mapped in
+	// advance at the offset for the handle is bound to the context.
+	for (handle = 0; handle < slots; ++handle) {
+		ic = client->iso_contexts[handle];
+		if (!ic || !ic->context)
+			break;
+	}
+	if (handle >= slots)
+		return -EBUSY;
+
+	ic = get_iso_client_context(client, handle);
+	if (!ic)
+		return -ENOMEM;
+
+	if (type == FW_ISO_CONTEXT_RECEIVE_MULTICHANNEL)
+		context = fw_iso_mc_context_create(client->device->card, iso_mc_callback, ic);
 	else
-		context = fw_iso_context_create(client->device->card, a->type, a->channel, a->speed,
-						a->header_size, iso_callback, client);
+		context = fw_iso_context_create(client->device->card, type, a->channel, a->speed,
+						a->header_size, iso_callback, ic);
 	if (IS_ERR(context))
 		return PTR_ERR(context);
 	if (client->version < FW_CDEV_VERSION_AUTO_FLUSH_ISO_OVERFLOW)
 		context->flags |= FW_ISO_CONTEXT_FLAG_DROP_OVERFLOW_HEADERS;
-
-	// We only support one context at this time.
-	scoped_guard(mutex, &client->iso_context_mutex) {
-		if (client->iso_context != NULL) {
+	if (polling)
+		context->flags |= FW_ISO_CONTEXT_FLAG_POLLING;
+
+	// The DMA mapping operation is available if the buffer is already allocated by mmap(2)
+	// system call. If not, it is delegated to the system call.
+	if (ic->buffer.pages && !ic->buffer.dma_addrs) {
+		ret = fw_iso_buffer_map_dma(&ic->buffer, client->device->card,
+					    iso_dma_direction(context));
+		if (ret < 0) {
 			fw_iso_context_destroy(context);
 
-			return -EBUSY;
-		}
-		// The DMA mapping operation is available if the buffer is already allocated by
-		// mmap(2) system call. If not, it is delegated to the system call.
-		if (client->buffer.pages && !client->buffer.dma_addrs) {
-			ret = fw_iso_buffer_map_dma(&client->buffer, client->device->card,
-						    iso_dma_direction(context));
-			if (ret < 0) {
-				fw_iso_context_destroy(context);
-
-				return ret;
-			}
+			return ret;
 		}
-		client->iso_closure = a->closure;
-		client->iso_context = context;
 	}
+	ic->closure = a->closure;
+	ic->context = context;
 
-	a->handle = 0;
+	a->handle = handle;
 
 	return 0;
 }
@@ -1111,12 +1570,12 @@ static int ioctl_create_iso_context(struct client *client, union ioctl_arg *arg)
 static int ioctl_set_iso_channels(struct client *client, union ioctl_arg *arg)
 {
 	struct fw_cdev_set_iso_channels *a = &arg->set_iso_channels;
-	struct fw_iso_context *ctx = client->iso_context;
+	struct iso_client_context *ic = lookup_iso_client_context(client, a->handle);
 
-	if (ctx == NULL || a->handle != 0)
+	if (ic == NULL)
 		return -EINVAL;
 
-	return fw_iso_context_set_channels(ctx, &a->channels);
+	return fw_iso_context_set_channels(ic->context, &a->channels);
 }
 
 /* Macros for decoding the iso packet control header. */
@@ -1127,18 +1586,46 @@ static int ioctl_set_iso_channels(struct client *client, union ioctl_arg *arg)
 #define GET_SY(v)		(((v) >> 20) & 0x0f)
 #define GET_HEADER_LENGTH(v)	(((v) >> 24) & 0xff)
 
+// Synchronize the payloads of the packets for device at once, instead of per packet when queueing.
+static void sync_iso_payloads(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+			      struct fw_cdev_iso_packet __user *p,
+			      struct fw_cdev_iso_packet __user *end,
+			      unsigned long payload, unsigned long buffer_end)
+{
+	unsigned long length = 0;
+	u32 control;
+
+	while (p < end && payload + length < buffer_end) {
+		if (get_user(control, &p->control))
+			break;
+		length += GET_PAYLOAD_LENGTH(control);
+
+		if (ctx->type == FW_ISO_CONTEXT_TRANSMIT)
+			p = (struct fw_cdev_iso_packet __user *)
+				&p->header[GET_HEADER_LENGTH(control) / 4];
+		else
+			p = (struct fw_cdev_iso_packet __user *)&p->header[0];
+	}
+
+	fw_iso_context_sync_payloads(ctx, buffer, payload, min(length, buffer_end - payload));
+}
+
 static int ioctl_queue_iso(struct client *client, union ioctl_arg *arg)
 {
 	struct fw_cdev_queue_iso *a = &arg->queue_iso;
 	struct fw_cdev_iso_packet __user *p, *end, *next;
-	struct fw_iso_context *ctx = client->iso_context;
+	struct iso_client_context *ic = lookup_iso_client_context(client, a->handle);
+	struct fw_iso_buffer *buffer;
+	struct fw_iso_context *ctx;
 	unsigned long payload, buffer_end, transmit_header_bytes = 0;
 	u32 control;
 	int count;
 	DEFINE_RAW_FLEX(struct fw_iso_packet, u, header, 64);
 
-	if (ctx == NULL || a->handle != 0)
+	if (ic == NULL)
 		return -EINVAL;
+	ctx = ic->context;
+	buffer = &ic->buffer;
 
 	/*
 	 * If the user passes a non-NULL data pointer, has mmap()'ed
@@ -1149,9 +1636,9 @@ static int ioctl_queue_iso(struct client *client, union ioctl_arg *arg)
 	 * use the indirect payload, the iso buffer need not be mapped
 	 * and the a->data pointer is ignored.
 	 */
-	payload = (unsigned long)a->data - client->vm_start;
-	buffer_end = client->buffer.page_count << PAGE_SHIFT;
-	if (a->data == 0 || client->buffer.pages == NULL ||
+	payload = (unsigned long)a->data - ic->vm_start;
+	buffer_end = buffer->page_count << PAGE_SHIFT;
+	if (a->data == 0 || buffer->pages == NULL ||
 	    payload >= buffer_end) {
 		payload = 0;
 		buffer_end = 0;
@@ -1163,6 +1650,10 @@ static int ioctl_queue_iso(struct client *client, union ioctl_arg *arg)
 	p = (struct fw_cdev_iso_packet __user *)u64_to_uptr(a->packets);
 
 	end = (void __user *)p + a->size;
+
+	if (buffer->need_sync && buffer_end > 0)
+		sync_iso_payloads(ctx, buffer, p, end, payload, buffer_end);
+
 	count = 0;
 	while (p < end) {
 		if (get_user(control, &p->control))
@@ -1207,7 +1698,7 @@ static int ioctl_queue_iso(struct client *client, union ioctl_arg *arg)
 		if (payload + u->payload_length > buffer_end)
 			return -EINVAL;
 
-		if (fw_iso_context_queue(ctx, u, &client->buffer, payload))
+		if (fw_iso_context_queue(ctx, u, buffer, payload))
 			break;
 
 		p = next;
@@ -1218,7 +1709,7 @@ static int ioctl_queue_iso(struct client *client, union ioctl_arg *arg)
 
 	a->size    -= uptr_to_u64(p) - a->packets;
 	a->packets  = uptr_to_u64(p);
-	a->data     = client->vm_start + payload;
+	a->data     = ic->vm_start + payload;
 
 	return count;
 }
@@ -1226,6 +1717,7 @@ static int ioctl_queue_iso(struct client *client, union ioctl_arg *arg)
 static int ioctl_start_iso(struct client *client, union ioctl_arg *arg)
 {
 	struct fw_cdev_start_iso *a = &arg->start_iso;
+	struct iso_client_context *ic = lookup_iso_client_context(client, a->handle);
 
 	BUILD_BUG_ON(
 	    FW_CDEV_ISO_CONTEXT_MATCH_TAG0 != FW_ISO_CONTEXT_MATCH_TAG0 ||
@@ -1234,35 +1726,36 @@ static int ioctl_start_iso(struct client *client, union ioctl_arg *arg)
 	    FW_CDEV_ISO_CONTEXT_MATCH_TAG3 != FW_ISO_CONTEXT_MATCH_TAG3 ||
 	    FW_CDEV_ISO_CONTEXT_MATCH_ALL_TAGS != FW_ISO_CONTEXT_MATCH_ALL_TAGS);
 
-	if (client->iso_context == NULL || a->handle != 0)
+	if (ic == NULL)
 		return -EINVAL;
 
-	if (client->iso_context->type == FW_ISO_CONTEXT_RECEIVE &&
+	if (ic->context->type == FW_ISO_CONTEXT_RECEIVE &&
 	    (a->tags == 0 || a->tags > 15 || a->sync > 15))
 		return -EINVAL;
 
-	return fw_iso_context_start(client->iso_context,
-				    a->cycle, a->sync, a->tags);
+	return fw_iso_context_start(ic->context, a->cycle, a->sync, a->tags);
 }
 
 static int ioctl_stop_iso(struct client *client, union ioctl_arg *arg)
 {
 	struct fw_cdev_stop_iso *a = &arg->stop_iso;
+	struct iso_client_context *ic = lookup_iso_client_context(client, a->handle);
 
-	if (client->iso_context == NULL || a->handle != 0)
+	if (ic == NULL)
 		return -EINVAL;
 
-	return fw_iso_context_stop(client->iso_context);
+	return fw_iso_context_stop(ic->context);
 }
 
 static int ioctl_flush_iso(struct client *client, union ioctl_arg *arg)
 {
 	struct fw_cdev_flush_iso *a = &arg->flush_iso;
+	struct iso_client_context *ic = lookup_iso_client_context(client, a->handle);
 
-	if (client->iso_context == NULL || a->handle != 0)
+	if (ic == NULL)
 		return -EINVAL;
 
-	return fw_iso_context_flush_completions(client->iso_context);
+	return fw_iso_context_flush_completions(ic->context);
 }
 
 static int ioctl_get_cycle_timer2(struct client *client, union ioctl_arg *arg)
@@ -1275,7 +1768,9 @@ static int ioctl_get_cycle_timer2(struct client *client, union ioctl_arg *arg)
 
 	guard(irq)();
 
-	ret = fw_card_read_cycle_time(card, &cycle_time);
+	// The estimation never reflects the drift between the clocks, which the caller is going to
+	// measure.
+	ret = fw_card_read_cycle_time_precise(card, &cycle_time);
 	if (ret < 0)
 		return ret;
 
@@ -1788,6 +2283,47 @@ void fw_cdev_handle_phy_packet(struct fw_card *card, struct fw_packet *p)
 	}
 }
 
+static int ioctl_setup_event_ring(struct client *client, union ioctl_arg *arg)
+{
+	struct fw_cdev_setup_event_ring *a = &arg->setup_event_ring;
+	struct event_ring *ring __free(kfree) = NULL;
+	void *area __free(vfree) = NULL;
+	bool busy;
+
+	if (!is_power_of_2(a->size) || a->size < EVENT_RING_MIN_SIZE ||
+	    a->size > EVENT_RING_MAX_SIZE)
+		return -EINVAL;
+
+	ring = kzalloc_obj(*ring);
+	if (!ring)
+		return -ENOMEM;
+
+	// The header occupies the first page so that the data area is page-aligned.
+	ring->data_offset = PAGE_ALIGN(sizeof(*ring->header));
+	ring->size = a->size;
+	area = vmalloc_user(ring->data_offset + ring->size);
+	if (!area)
+		return -ENOMEM;
+	ring->header = area;
+	ring->data = area + ring->data_offset;
+
+	scoped_guard(spinlock_irq, &client->lock) {
+		busy = !!client->event_ring;
+		if (!busy)
+			client->event_ring = ring;
+	}
+	if (busy)
+		return -EBUSY;
+
+	a->data_offset = ring->data_offset;
+	a->mmap_offset = EVENT_RING_MMAP_OFFSET;
+
+	retain_and_null_ptr(area);
+	retain_and_null_ptr(ring);
+
+	return 0;
+}
+
 static int (* const ioctl_handlers[])(struct client *, union ioctl_arg *) = {
 	[0x00] = ioctl_get_info,
 	[0x01] = ioctl_send_request,
@@ -1814,6 +2350,9 @@ static int (* const ioctl_handlers[])(struct client *, union ioctl_arg *) = {
 	[0x16] = ioctl_receive_phy_packets,
 	[0x17] = ioctl_set_iso_channels,
 	[0x18] = ioctl_flush_iso,
+	[0x19] = ioctl_setup_event_ring,
+	[0x1a] = ioctl_send_requests,
+	[0x1b] = ioctl_run_transaction,
 };
 
 static int dispatch_ioctl(struct client *client,
@@ -1853,54 +2392,86 @@ static long fw_device_op_ioctl(struct file *file,
 	return dispatch_ioctl(file->private_data, cmd, (void __user *)arg);
 }
 
+static int mmap_event_ring(struct client *client, struct vm_area_struct *vma)
+{
+	struct event_ring *ring;
+
+	// The ring is never released until the file is released.
+	scoped_guard(spinlock_irq, &client->lock)
+		ring = client->event_ring;
+	if (!ring)
+		return -EINVAL;
+
+	if (vma->vm_end - vma->vm_start != ring->data_offset + ring->size)
+		return -EINVAL;
+
+	return remap_vmalloc_range(vma, ring->header, 0);
+}
+
 static int fw_device_op_mmap(struct file *file, struct vm_area_struct *vma)
 {
 	struct client *client = file->private_data;
-	unsigned long size;
+	struct iso_client_context *ic;
+	unsigned long size, handle;
 	int page_count, ret;
 
 	if (fw_device_is_shutdown(client->device))
 		return -ENODEV;
 
-	/* FIXME: We could support multiple buffers, but we don't. */
-	if (client->buffer.pages != NULL)
-		return -EBUSY;
-
 	if (!(vma->vm_flags & VM_SHARED))
 		return -EINVAL;
 
+	if (vma->vm_pgoff == EVENT_RING_MMAP_OFFSET >> PAGE_SHIFT)
+		return mmap_event_ring(client, vma);
+
+	// The offset selects the isochronous context by its handle. It is ignored for the former
+	// clients, which have the single context.
+	if (client->version < FW_CDEV_VERSION_MULTIPLE_ISO_CONTEXTS)
+		handle = 0;
+	else
+		handle = vma->vm_pgoff / (FW_CDEV_ISO_BUFFER_MMAP_STRIDE >> PAGE_SHIFT);
+	if (handle >= ISO_CONTEXT_SLOTS)
+		return -EINVAL;
+
 	if (vma->vm_start & ~PAGE_MASK)
 		return -EINVAL;
 
-	client->vm_start = vma->vm_start;
 	size = vma->vm_end - vma->vm_start;
 	page_count = size >> PAGE_SHIFT;
 	if (size & ~PAGE_MASK)
 		return -EINVAL;
 
-	ret = fw_iso_buffer_alloc(&client->buffer, page_count);
+	guard(mutex)(&client->iso_context_mutex);
+
+	ic = get_iso_client_context(client, handle);
+	if (!ic)
+		return -ENOMEM;
+
+	if (ic->buffer.pages != NULL)
+		return -EBUSY;
+
+	ret = fw_iso_buffer_alloc(&ic->buffer, page_count);
 	if (ret < 0)
 		return ret;
 
-	scoped_guard(mutex, &client->iso_context_mutex) {
-		// The direction of DMA can be determined if the isochronous context is already
-		// allocated. If not, the DMA mapping operation is postponed after the allocation.
-		if (client->iso_context) {
-			ret = fw_iso_buffer_map_dma(&client->buffer, client->device->card,
-						    iso_dma_direction(client->iso_context));
-			if (ret < 0)
-				goto fail;
-		}
+	// The direction of DMA can be determined if the isochronous context is already allocated.
+	// If not, the DMA mapping operation is postponed after the allocation.
+	if (ic->context) {
+		ret = fw_iso_buffer_map_dma(&ic->buffer, client->device->card,
+					    iso_dma_direction(ic->context));
+		if (ret < 0)
+			goto fail;
 	}
 
-	ret = vm_map_pages_zero(vma, client->buffer.pages,
-				client->buffer.page_count);
+	ret = vm_map_pages_zero(vma, ic->buffer.pages, ic->buffer.page_count);
 	if (ret < 0)
 		goto fail;
 
+	ic->vm_start = vma->vm_start;
+
 	return 0;
  fail:
-	fw_iso_buffer_destroy(&client->buffer, client->device->card);
+	fw_iso_buffer_destroy(&ic->buffer, client->device->card);
 	return ret;
 }
 
@@ -1925,6 +2496,7 @@ static int fw_device_op_release(struct inode *inode, struct file *file)
 	struct event *event, *next_event;
 	struct client_resource *resource;
 	unsigned long index;
+	int i;
 
 	// NOTE: This can be without irq when we can guarantee that __fw_send_request() for local
 	// destination never runs in any type of IRQ context.
@@ -1934,12 +2506,18 @@ static int fw_device_op_release(struct inode *inode, struct file *file)
 	scoped_guard(mutex, &client->device->client_list_mutex)
 		list_del(&client->link);
 
-	if (client->iso_context)
-		fw_iso_context_destroy(client->iso_context);
-	mutex_destroy(&client->iso_context_mutex);
+	for (i = 0; i < ISO_CONTEXT_SLOTS; ++i) {
+		struct iso_client_context *ic = client->iso_contexts[i];
 
-	if (client->buffer.pages)
-		fw_iso_buffer_destroy(&client->buffer, client->device->card);
+		if (!ic)
+			continue;
+		if (ic->context)
+			fw_iso_context_destroy(ic->context);
+		if (ic->buffer.pages)
+			fw_iso_buffer_destroy(&ic->buffer, client->device->card);
+		kfree(ic);
+	}
+	mutex_destroy(&client->iso_context_mutex);
 
 	// Freeze client->resource_xa and client->event_list.
 	scoped_guard(spinlock_irq, &client->lock)
@@ -1956,6 +2534,11 @@ static int fw_device_op_release(struct inode *inode, struct file *file)
 	list_for_each_entry_safe(event, next_event, &client->event_list, link)
 		kfree(event);
 
+	if (client->event_ring) {
+		vfree(client->event_ring->header);
+		kfree(client->event_ring);
+	}
+
 	client_put(client);
 
 	return 0;
@@ -1970,8 +2553,13 @@ static __poll_t fw_device_op_poll(struct file *file, poll_table * pt)
 
 	if (fw_device_is_shutdown(client->device))
 		mask |= EPOLLHUP | EPOLLERR;
-	if (!list_empty(&client->event_list))
-		mask |= EPOLLIN | EPOLLRDNORM;
+	scoped_guard(spinlock_irq, &client->lock) {
+		struct event_ring *ring = client->event_ring;
+
+		if (!list_empty(&client->event_list) ||
+		    (ring && READ_ONCE(ring->header->tail) != ring->head))
+			mask |= EPOLLIN | EPOLLRDNORM;
+	}
 
 	return mask;
 }
@@ -13,7 +13,10 @@
 #include <linux/firewire-constants.h>
 #include <linux/kernel.h>
 #include <linux/mm.h>
+#include <linux/mutex.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
+#include <linux/sort.h>
 #include <linux/spinlock.h>
 #include <linux/vmalloc.h>
 #include <linux/export.h>
@@ -21,6 +24,7 @@
 #include <asm/byteorder.h>
 
 #include "core.h"
+#include "packet-header-definitions.h"
 
 #include <trace/events/firewire.h>
 
@@ -28,60 +32,139 @@
  * Isochronous DMA context management
  */
 
+// The maximum size of isochronous packet payload is 65535 bytes.
+#define ISO_BUFFER_CHUNK_ORDER	get_order(SZ_64K)
+
 int fw_iso_buffer_alloc(struct fw_iso_buffer *buffer, int page_count)
 {
 	struct page **page_array __free(kfree) = kzalloc_objs(page_array[0],
 							      page_count);
+	unsigned int *chunks __free(kfree) = kzalloc_objs(chunks[0], page_count);
+	unsigned int *chunk_ends __free(kfree) = kzalloc_objs(chunk_ends[0], page_count);
+	unsigned int order = ISO_BUFFER_CHUNK_ORDER;
+	int i = 0, chunk_count = 0;
 
-	if (!page_array)
+	if (!page_array || !chunks || !chunk_ends)
 		return -ENOMEM;
 
-	// Retrieve noncontiguous pages. The descriptors for 1394 OHCI isochronous DMA contexts
-	// have a set of address and length per each, while the reason to use pages is the
-	// convenience to map them into virtual address space of user process.
-	unsigned long nr_populated = alloc_pages_bulk(GFP_KERNEL | GFP_DMA32 | __GFP_ZERO,
-						      page_count, page_array);
-	if (nr_populated != page_count) {
-		// Assuming the above call fills page_array sequentially from the beginning.
-		release_pages(page_array, nr_populated);
-		return -ENOMEM;
+	// Retrieve physically contiguous chunks of pages as large as possible. The descriptors for
+	// 1394 OHCI isochronous DMA contexts have a set of address and length per each, thus the
+	// larger chunk reduces the number of descriptors split at the boundary of pages. The chunks
+	// are split into pages for the convenience to map them into virtual address space of user
+	// process. Fall back to lower order when the allocation fails.
+	while (i < page_count && order > 0) {
+		struct page *page;
+
+		if ((1 << order) > page_count - i) {
+			--order;
+			continue;
+		}
+
+		page = alloc_pages(GFP_KERNEL | GFP_DMA32 | __GFP_ZERO | __GFP_NORETRY | __GFP_NOWARN,
+				   order);
+		if (!page) {
+			--order;
+			continue;
+		}
+		split_page(page, order);
+
+		for (int j = 0; j < (1 << order); ++j) {
+			page_array[i + j] = page + j;
+			chunk_ends[i + j] = i + (1 << order);
+		}
+		chunks[chunk_count++] = 1 << order;
+		i += 1 << order;
+	}
+
+	if (i < page_count) {
+		unsigned long nr_populated = alloc_pages_bulk(GFP_KERNEL | GFP_DMA32 | __GFP_ZERO,
+							      page_count - i, page_array + i);
+		if (nr_populated != page_count - i) {
+			// Assuming the above call fills page_array sequentially from the beginning.
+			release_pages(page_array, i + nr_populated);
+			return -ENOMEM;
+		}
+
+		while (i < page_count) {
+			chunks[chunk_count++] = 1;
+			chunk_ends[i] = i + 1;
+			++i;
+		}
 	}
 
 	buffer->page_count = page_count;
 	buffer->pages = no_free_ptr(page_array);
+	buffer->chunks = no_free_ptr(chunks);
+	buffer->chunk_count = chunk_count;
+	buffer->chunk_ends = no_free_ptr(chunk_ends);
 
 	return 0;
 }
 
+static int compare_page_dma_addr(const void *a, const void *b, const void *priv)
+{
+	const dma_addr_t *dma_addrs = priv;
+	dma_addr_t lhs = dma_addrs[*(const unsigned int *)a];
+	dma_addr_t rhs = dma_addrs[*(const unsigned int *)b];
+
+	if (lhs < rhs)
+		return -1;
+	else if (lhs > rhs)
+		return 1;
+	else
+		return 0;
+}
+
 int fw_iso_buffer_map_dma(struct fw_iso_buffer *buffer, struct fw_card *card,
 			  enum dma_data_direction direction)
 {
 	dma_addr_t *dma_addrs __free(kfree) = kzalloc_objs(dma_addrs[0],
 							   buffer->page_count);
-	int i;
+	unsigned int *sorted_pages __free(kfree) = kzalloc_objs(sorted_pages[0],
+								buffer->page_count);
+	int i, chunk, page;
 
-	if (!dma_addrs)
+	if (!dma_addrs || !sorted_pages)
 		return -ENOMEM;
 
-	// Retrieve DMA mapping addresses for the pages. They are not contiguous. Maintain the cache
-	// coherency for the pages by hand.
-	for (i = 0; i < buffer->page_count; i++) {
-		// The dma_map_phys() with a physical address per page is available here, instead.
-		dma_addr_t dma_addr = dma_map_page(card->device, buffer->pages[i], 0, PAGE_SIZE,
+	// Retrieve DMA mapping addresses for the chunks of pages. They are not contiguous. Maintain
+	// the cache coherency for the pages by hand.
+	buffer->need_sync = false;
+	for (chunk = 0, page = 0; chunk < buffer->chunk_count; page += buffer->chunks[chunk++]) {
+		size_t size = (size_t)buffer->chunks[chunk] << PAGE_SHIFT;
+		// The dma_map_phys() with a physical address per chunk is available here, instead.
+		dma_addr_t dma_addr = dma_map_page(card->device, buffer->pages[page], 0, size,
 						   direction);
 		if (dma_mapping_error(card->device, dma_addr))
 			break;
 
-		dma_addrs[i] = dma_addr;
+		for (i = 0; i < buffer->chunks[chunk]; ++i)
+			dma_addrs[page + i] = dma_addr + ((dma_addr_t)i << PAGE_SHIFT);
+
+		// On cache-coherent platforms without bounce buffering, the cache maintenance by
+		// hand is a no-op. Skip it entirely.
+		if (dma_need_sync(card->device, dma_addr))
+			buffer->need_sync = true;
 	}
-	if (i < buffer->page_count) {
-		while (i-- > 0)
-			dma_unmap_page(card->device, dma_addrs[i], PAGE_SIZE, buffer->direction);
+	if (chunk < buffer->chunk_count) {
+		while (chunk-- > 0) {
+			page -= buffer->chunks[chunk];
+			dma_unmap_page(card->device, dma_addrs[page],
+				       (size_t)buffer->chunks[chunk] << PAGE_SHIFT, direction);
+		}
 		return -ENOMEM;
 	}
 
+	// The index of pages sorted by the DMA address, to look up the offset in the buffer from the
+	// DMA address by binary search.
+	for (i = 0; i < buffer->page_count; i++)
+		sorted_pages[i] = i;
+	sort_r(sorted_pages, buffer->page_count, sizeof(sorted_pages[0]), compare_page_dma_addr,
+	       NULL, dma_addrs);
+
 	buffer->direction = direction;
 	buffer->dma_addrs = no_free_ptr(dma_addrs);
+	buffer->sorted_pages = no_free_ptr(sorted_pages);
 
 	return 0;
 }
@@ -107,35 +190,62 @@ void fw_iso_buffer_destroy(struct fw_iso_buffer *buffer,
 			   struct fw_card *card)
 {
 	if (buffer->dma_addrs) {
-		for (int i = 0; i < buffer->page_count; ++i) {
-			dma_addr_t dma_addr = buffer->dma_addrs[i];
-			dma_unmap_page(card->device, dma_addr, PAGE_SIZE, buffer->direction);
+		for (int chunk = 0, page = 0; chunk < buffer->chunk_count;
+		     page += buffer->chunks[chunk++]) {
+			dma_addr_t dma_addr = buffer->dma_addrs[page];
+			dma_unmap_page(card->device, dma_addr,
+				       (size_t)buffer->chunks[chunk] << PAGE_SHIFT, buffer->direction);
 		}
 		kfree(buffer->dma_addrs);
 		buffer->dma_addrs = NULL;
 	}
 
+	kfree(buffer->sorted_pages);
+	buffer->sorted_pages = NULL;
+
 	if (buffer->pages) {
 		release_pages(buffer->pages, buffer->page_count);
 		kfree(buffer->pages);
 		buffer->pages = NULL;
 	}
 
+	kfree(buffer->chunks);
+	buffer->chunks = NULL;
+	buffer->chunk_count = 0;
+	kfree(buffer->chunk_ends);
+	buffer->chunk_ends = NULL;
+
 	buffer->page_count = 0;
+	buffer->need_sync = false;
 }
 EXPORT_SYMBOL(fw_iso_buffer_destroy);
 
 /* Convert DMA address to offset into virtually contiguous buffer. */
 size_t fw_iso_buffer_lookup(struct fw_iso_buffer *buffer, dma_addr_t completed)
 {
-	for (int i = 0; i < buffer->page_count; i++) {
-		dma_addr_t dma_addr = buffer->dma_addrs[i];
-		ssize_t offset = (ssize_t)completed - (ssize_t)dma_addr;
-		if (offset > 0 && offset <= PAGE_SIZE)
-			return (i << PAGE_SHIFT) + offset;
+	unsigned int low = 0, high = buffer->page_count;
+	unsigned int page;
+	dma_addr_t dma_addr;
+
+	// The given address points to the end of completed data, thus it can be the end of page.
+	// Find the page with the largest DMA address below it.
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+
+		if (buffer->dma_addrs[buffer->sorted_pages[mid]] < completed)
+			low = mid + 1;
+		else
+			high = mid;
 	}
+	if (low == 0)
+		return 0;
 
-	return 0;
+	page = buffer->sorted_pages[low - 1];
+	dma_addr = buffer->dma_addrs[page];
+	if (completed - dma_addr > PAGE_SIZE)
+		return 0;
+
+	return ((size_t)page << PAGE_SHIFT) + (completed - dma_addr);
 }
 
 struct fw_iso_context *__fw_iso_context_create(struct fw_card *card, int type, int channel,
@@ -154,6 +264,10 @@ struct fw_iso_context *__fw_iso_context_create(struct fw_card *card, int type, i
 	ctx->channel = channel;
 	ctx->speed = speed;
 	ctx->flags = 0;
+	ctx->completion_cpu = WORK_CPU_UNBOUND;
+	ctx->irq_interval.min = 0;
+	ctx->irq_interval.max = 0;
+	memset(&ctx->poll_stats, 0, sizeof(ctx->poll_stats));
 	ctx->header_size = header_size;
 	ctx->header_storage_size = header_storage_size;
 	ctx->callback = callback;
@@ -177,6 +291,103 @@ void fw_iso_context_destroy(struct fw_iso_context *ctx)
 }
 EXPORT_SYMBOL(fw_iso_context_destroy);
 
+/**
+ * fw_iso_context_reserve_descriptors() - preallocate the DMA program of the context.
+ * @ctx: the isochronous context
+ * @packets: the expected maximum number of packets queued in the context at the same time
+ * @header_length: the maximum length of header in a packet to transmit. Ignored for the context to
+ *		   receive, since the header_size given at creation of the context is used instead.
+ * @payload_length: the maximum length of payload in a packet
+ *
+ * By default, the card driver grows the DMA program of the context on demand when queueing
+ * packets, thus the allocation of memory could happen in atomic context with latency. This
+ * function preallocates the DMA program enough to store the given number of packets, then the
+ * context works as a fixed-size ring. The number of descriptors per packet is derived from the
+ * lengths of header and payload. Queueing packets to the full ring fails immediately with
+ * -ENOBUFS instead of growing the DMA program.
+ *
+ * Context: Process context. It should be called before queueing any packet.
+ *
+ * Return: 0 on success, or negative error code.
+ */
+int fw_iso_context_reserve_descriptors(struct fw_iso_context *ctx, unsigned int packets,
+				       size_t header_length, size_t payload_length)
+{
+	might_sleep();
+
+	if (packets == 0 || payload_length > U16_MAX)
+		return -EINVAL;
+
+	return ctx->card->driver->reserve_iso_descriptors(ctx, packets, header_length,
+							  payload_length);
+}
+EXPORT_SYMBOL(fw_iso_context_reserve_descriptors);
+
+/**
+ * fw_iso_context_create_ring_program() - build the DMA program of IT context as a closed loop.
+ * @ctx: the isochronous context of FW_ISO_CONTEXT_TRANSMIT type
+ * @buffer: the buffer for payload of packets
+ * @slots: the number of packets in the loop
+ * @slot_size: the maximum size of payload for each packet, up to PAGE_SIZE
+ * @irq_interval: the number of packets between hardware interrupts
+ * @tag: the tag of packets
+ *
+ * By default, the DMA program for each packet is built when queueing it. For the stream of packets
+ * in constant size, this function builds the DMA program once for @slots packets, linked as a
+ * closed loop. The payload of each packet is at the slot in @buffer, located by
+ * fw_iso_ring_slot_offset(). Once the context is started, the packets in the loop are transmitted
+ * repeatedly, one per isochronous cycle, and the producer updates the payload in the slot, then
+ * calls fw_iso_context_update_ring_slot() before the slot is transmitted again. The completed
+ * slots are reported in order to the callback of context in the same way as queued packets, with
+ * the interrupt flag at every @irq_interval slots. fw_iso_context_queue() is not available for
+ * the context anymore.
+ *
+ * Context: Process context. It should be called before queueing any packet.
+ *
+ * Return: 0 on success, -EINVAL if the parameters are invalid, -EOPNOTSUPP if the type of context
+ * is not supported, -EBUSY if any packet is queued already, or negative error code.
+ */
+int fw_iso_context_create_ring_program(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+				       unsigned int slots, unsigned int slot_size,
+				       unsigned int irq_interval, int tag)
+{
+	might_sleep();
+
+	if (ctx->type != FW_ISO_CONTEXT_TRANSMIT)
+		return -EOPNOTSUPP;
+
+	if (slots == 0 || slot_size == 0 || slot_size > PAGE_SIZE || irq_interval == 0 ||
+	    tag < 0 || tag > 3)
+		return -EINVAL;
+
+	if (DIV_ROUND_UP(slots, PAGE_SIZE / slot_size) > buffer->page_count)
+		return -EINVAL;
+
+	return ctx->card->driver->create_iso_ring_program(ctx, buffer, slots, slot_size,
+							  irq_interval, tag);
+}
+EXPORT_SYMBOL(fw_iso_context_create_ring_program);
+
+/**
+ * fw_iso_context_update_ring_slot() - publish the payload of the slot in the ring program.
+ * @ctx: the isochronous context with the ring program
+ * @index: the index of slot
+ * @length: the length of payload, up to the size of slot
+ *
+ * Make the payload updated by the producer in the slot visible to the hardware, and update the
+ * length of packet. The caller should call it enough before the slot is transmitted.
+ *
+ * Context: Any context.
+ *
+ * Return: 0 on success, or -EINVAL if the context has no ring program or the parameters are invalid.
+ */
+int fw_iso_context_update_ring_slot(struct fw_iso_context *ctx, unsigned int index,
+				    unsigned int length)
+{
+	return ctx->card->driver->update_iso_ring_slot(ctx, index, length);
+}
+EXPORT_SYMBOL(fw_iso_context_update_ring_slot);
+
 int fw_iso_context_start(struct fw_iso_context *ctx,
 			 int cycle, int sync, int tags)
 {
@@ -215,9 +426,54 @@ void fw_iso_context_queue_flush(struct fw_iso_context *ctx)
 	trace_isoc_inbound_multiple_flush(ctx);
 
 	ctx->card->driver->flush_queue_iso(ctx);
+
+	ctx->synced_payloads.buffer = NULL;
 }
 EXPORT_SYMBOL(fw_iso_context_queue_flush);
 
+/**
+ * fw_iso_context_sync_payloads() - synchronize payload of packets for device in advance.
+ * @ctx: the isochronous context
+ * @buffer: the buffer for payload of packets to be queued
+ * @payload: the offset of the first payload in @buffer
+ * @length: the total length of payloads contiguous from @payload
+ *
+ * By default, the payload of each packet is synchronized for device when queueing it, page by page.
+ * When queueing a series of packets whose payloads are contiguous in @buffer, this function
+ * synchronizes the whole range at once with a single operation per chunk of pages, then the
+ * payload of packets in the range is not synchronized again until fw_iso_context_queue_flush() or
+ * the next call of this function. The caller should finish writing the payloads in the range
+ * before calling this function.
+ *
+ * Context: Any context, but the caller should serialize it with fw_iso_context_queue().
+ */
+void fw_iso_context_sync_payloads(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+				  unsigned long payload, unsigned long length)
+{
+	unsigned long end = min(payload + length, (unsigned long)buffer->page_count << PAGE_SHIFT);
+	unsigned long index = payload;
+
+	ctx->synced_payloads.buffer = NULL;
+
+	if (!buffer->need_sync || index >= end)
+		return;
+
+	while (index < end) {
+		unsigned long page = index >> PAGE_SHIFT;
+		unsigned long offset = index & ~PAGE_MASK;
+		unsigned long size = fw_iso_buffer_contiguous_length(buffer, index, end - index);
+
+		dma_sync_single_range_for_device(ctx->card->device, buffer->dma_addrs[page], offset,
+						 size, buffer->direction);
+		index += size;
+	}
+
+	ctx->synced_payloads.buffer = buffer;
+	ctx->synced_payloads.start = payload;
+	ctx->synced_payloads.end = end;
+}
+EXPORT_SYMBOL(fw_iso_context_sync_payloads);
+
 /**
  * fw_iso_context_flush_completions() - process isochronous context in current process context.
  * @ctx: the isochronous context
@@ -230,6 +486,11 @@ EXPORT_SYMBOL(fw_iso_context_queue_flush);
  * required to process the context asynchronously, fw_iso_context_schedule_flush_completions() is
  * available instead.
  *
+ * When FW_ISO_CONTEXT_FLAG_POLLING is set to the context, the hardware interrupt for the context is
+ * masked and the consumer is expected to call this function periodically to process the context.
+ * The statistics of the calls are available in &fw_iso_context.poll_stats, exposed in debugfs of
+ * the card by the 1394 OHCI driver.
+ *
  * Context: Process context. May sleep due to disable_work_sync().
  */
 int fw_iso_context_flush_completions(struct fw_iso_context *ctx)
@@ -256,6 +517,80 @@ int fw_iso_context_flush_completions(struct fw_iso_context *ctx)
 }
 EXPORT_SYMBOL(fw_iso_context_flush_completions);
 
+/**
+ * fw_iso_context_set_completion_cpu() - steer the completion processing of the context to a CPU.
+ * @ctx: the isochronous context
+ * @cpu: the CPU to process the completions, or WORK_CPU_UNBOUND to let any CPU process them.
+ *
+ * By default, the work items of all isochronous contexts in a card are queued to the same unbound
+ * workqueue, thus the completions of a latency-critical context could wait for the ones of the
+ * other contexts processed by the same worker. This function steers the work item of the context
+ * to the per-CPU workqueue of the card so that it is processed in the given CPU. Multiple contexts
+ * can share the same CPU to group them. When the CPU is offline at the time of scheduling, the
+ * work item is queued to the per-CPU workqueue on the local CPU instead.
+ *
+ * Context: Process context. May sleep due to disable_work_sync().
+ *
+ * Return: 0 on success, or -EINVAL if the CPU is invalid.
+ */
+int fw_iso_context_set_completion_cpu(struct fw_iso_context *ctx, int cpu)
+{
+	might_sleep();
+
+	if (cpu != WORK_CPU_UNBOUND && (cpu < 0 || cpu >= nr_cpu_ids || !cpu_possible(cpu)))
+		return -EINVAL;
+
+	// Avoid dead lock due to programming mistake.
+	if (WARN_ON_ONCE(current_work() == &ctx->work))
+		return -EINVAL;
+
+	// The work item should not be executed in both workqueues concurrently.
+	disable_work_sync(&ctx->work);
+	WRITE_ONCE(ctx->completion_cpu, cpu);
+	enable_work(&ctx->work);
+
+	// Process any completion notified during the work item was disabled.
+	fw_iso_context_schedule_flush_completions(ctx);
+
+	return 0;
+}
+EXPORT_SYMBOL(fw_iso_context_set_completion_cpu);
+
+/**
+ * fw_iso_context_set_irq_interval() - enable adaptive interrupt coalescing for the IR context.
+ * @ctx: the isochronous context of FW_ISO_CONTEXT_RECEIVE type
+ * @min: the minimum number of packets between hardware interrupts
+ * @max: the maximum number of packets between hardware interrupts, or 0 to disable the mode.
+ *
+ * In the mode, the card driver places the hardware interrupt by itself instead of the interrupt
+ * flag of each queued packet. The interval starts at @min packets, grows while the completions
+ * are processed late or in backlog, and shrinks while the consumer keeps up with them, within
+ * the bounds. Since a packet is received per isochronous cycle, the bounds are latencies in the
+ * unit of 125 microseconds. The caller should keep at least @max packets queued in the context,
+ * otherwise the callback could be delayed until more packets are queued or
+ * fw_iso_context_flush_completions() is called.
+ *
+ * Context: Process context. It should be called before queueing any packet.
+ *
+ * Return: 0 on success, -EINVAL if the bounds are invalid, or -EOPNOTSUPP if the type of context
+ * is not supported.
+ */
+int fw_iso_context_set_irq_interval(struct fw_iso_context *ctx, unsigned int min,
+				    unsigned int max)
+{
+	if (ctx->type != FW_ISO_CONTEXT_RECEIVE)
+		return -EOPNOTSUPP;
+
+	if (max > 0 && (min == 0 || min > max))
+		return -EINVAL;
+
+	ctx->irq_interval.min = max > 0 ? min : 0;
+	ctx->irq_interval.max = max;
+
+	return 0;
+}
+EXPORT_SYMBOL(fw_iso_context_set_irq_interval);
+
 int fw_iso_context_stop(struct fw_iso_context *ctx)
 {
 	int err;
@@ -278,6 +613,304 @@ int fw_iso_context_stop(struct fw_iso_context *ctx)
 }
 EXPORT_SYMBOL(fw_iso_context_stop);
 
+/*
+ * Demultiplexer of multichannel isochronous reception
+ */
+
+// The size of buffer shared by all of consumers in the card.
+#define ISO_DEMUX_BUFFER_PAGES		64
+// The buffer is queued to the multichannel IR context page by page in buffer-fill mode, thus the
+// packets are stored contiguously across the pages, and the callback is called per page.
+#define ISO_DEMUX_CHUNK_SIZE		PAGE_SIZE
+
+// A packet in buffer-fill mode consists of header quadlet, payload padded to quadlet, and trailer
+// quadlet. The pages at the beginning of buffer are mapped again after the end of buffer so that
+// the packet wrapping around is contiguous in virtual address space.
+#define ISO_DEMUX_MAX_PACKET_SIZE	(4 + ALIGN(U16_MAX, 4) + 4)
+#define ISO_DEMUX_WRAPAROUND_PAGES	DIV_ROUND_UP(ISO_DEMUX_MAX_PACKET_SIZE, PAGE_SIZE)
+
+struct fw_iso_demux {
+	struct fw_iso_context *context;
+	struct fw_iso_buffer buffer;
+	void *vaddr;
+	size_t size;
+
+	// The offset to the next packet in the buffer.
+	size_t pos;
+	// The chunk to be queued again once it is consumed, and the consumed bytes since its start.
+	unsigned int next_chunk;
+	size_t unrecycled;
+
+	// The channels received by the context.
+	u64 channels;
+
+	// Protect the lists of consumers against the callback of context.
+	spinlock_t lock;
+	struct list_head consumers[64];
+};
+
+// Serialize the creation, the destruction, and the change of channels for the demultiplexer.
+static DEFINE_MUTEX(iso_demux_mutex);
+
+static int iso_demux_queue_chunk(struct fw_iso_demux *demux, unsigned int index)
+{
+	struct fw_iso_packet packet = {
+		.payload_length = ISO_DEMUX_CHUNK_SIZE,
+		.interrupt = 1,
+	};
+
+	return fw_iso_context_queue(demux->context, &packet, &demux->buffer,
+				    index * ISO_DEMUX_CHUNK_SIZE);
+}
+
+static void iso_demux_callback(struct fw_iso_context *context, dma_addr_t completed, void *data)
+{
+	struct fw_iso_demux *demux = data;
+	size_t end, avail;
+	bool queued = false;
+
+	// The lookup never returns zero for valid address.
+	end = fw_iso_buffer_lookup(&demux->buffer, completed);
+	if (end == 0)
+		return;
+
+	if (end >= demux->pos)
+		avail = end - demux->pos;
+	else
+		avail = demux->size - demux->pos + end;
+
+	scoped_guard(spinlock, &demux->lock) {
+		while (avail >= 8) {
+			const __le32 *p = demux->vaddr + demux->pos;
+			u32 header = le32_to_cpu(p[0]);
+			size_t length = 4 + ALIGN(isoc_header_get_data_length(header), 4) + 4;
+			struct fw_iso_demux_consumer *consumer;
+			u16 timestamp;
+
+			// The rest of packet is not stored yet.
+			if (length > avail)
+				break;
+
+			timestamp = le32_to_cpu(p[length / 4 - 1]) & 0xffff;
+
+			list_for_each_entry(consumer, &demux->consumers[isoc_header_get_channel(header)],
+					    link)
+				consumer->callback(consumer, header, (const __be32 *)(p + 1), timestamp);
+
+			demux->pos += length;
+			if (demux->pos >= demux->size)
+				demux->pos -= demux->size;
+			demux->unrecycled += length;
+			avail -= length;
+		}
+	}
+
+	// Queue the consumed chunks again for the subsequent packets.
+	while (demux->unrecycled >= ISO_DEMUX_CHUNK_SIZE) {
+		if (iso_demux_queue_chunk(demux, demux->next_chunk) < 0)
+			break;
+		demux->next_chunk = (demux->next_chunk + 1) % (demux->size / ISO_DEMUX_CHUNK_SIZE);
+		demux->unrecycled -= ISO_DEMUX_CHUNK_SIZE;
+		queued = true;
+	}
+	if (queued)
+		fw_iso_context_queue_flush(context);
+}
+
+static void iso_demux_destroy(struct fw_iso_demux *demux, struct fw_card *card)
+{
+	if (!IS_ERR_OR_NULL(demux->context)) {
+		fw_iso_context_stop(demux->context);
+		fw_iso_context_destroy(demux->context);
+	}
+	if (demux->vaddr)
+		vunmap(demux->vaddr);
+	fw_iso_buffer_destroy(&demux->buffer, card);
+	kfree(demux);
+}
+
+static struct fw_iso_demux *iso_demux_create(struct fw_card *card)
+{
+	struct fw_iso_demux *demux;
+	struct page **pages;
+	unsigned int i;
+	int err;
+
+	demux = kzalloc_obj(*demux);
+	if (!demux)
+		return ERR_PTR(-ENOMEM);
+	spin_lock_init(&demux->lock);
+	for (i = 0; i < ARRAY_SIZE(demux->consumers); ++i)
+		INIT_LIST_HEAD(&demux->consumers[i]);
+
+	err = fw_iso_buffer_init(&demux->buffer, card, ISO_DEMUX_BUFFER_PAGES, DMA_FROM_DEVICE);
+	if (err < 0)
+		goto error;
+	demux->size = ISO_DEMUX_BUFFER_PAGES * PAGE_SIZE;
+
+	pages = kmalloc_array(ISO_DEMUX_BUFFER_PAGES + ISO_DEMUX_WRAPAROUND_PAGES, sizeof(*pages),
+			      GFP_KERNEL);
+	if (!pages) {
+		err = -ENOMEM;
+		goto error;
+	}
+	for (i = 0; i < ISO_DEMUX_BUFFER_PAGES; ++i)
+		pages[i] = demux->buffer.pages[i];
+	for (i = 0; i < ISO_DEMUX_WRAPAROUND_PAGES; ++i)
+		pages[ISO_DEMUX_BUFFER_PAGES + i] = demux->buffer.pages[i];
+	demux->vaddr = vmap(pages, ISO_DEMUX_BUFFER_PAGES + ISO_DEMUX_WRAPAROUND_PAGES, VM_MAP,
+			    PAGE_KERNEL);
+	kfree(pages);
+	if (!demux->vaddr) {
+		err = -ENOMEM;
+		goto error;
+	}
+
+	demux->context = fw_iso_mc_context_create(card, iso_demux_callback, demux);
+	if (IS_ERR(demux->context)) {
+		err = PTR_ERR(demux->context);
+		goto error;
+	}
+
+	for (i = 0; i < demux->size / ISO_DEMUX_CHUNK_SIZE; ++i) {
+		err = iso_demux_queue_chunk(demux, i);
+		if (err < 0)
+			goto error;
+	}
+	fw_iso_context_queue_flush(demux->context);
+
+	err = fw_iso_context_start(demux->context, -1, 0, FW_ISO_CONTEXT_MATCH_ALL_TAGS);
+	if (err < 0)
+		goto error;
+
+	return demux;
+error:
+	iso_demux_destroy(demux, card);
+	return ERR_PTR(err);
+}
+
+/**
+ * fw_iso_demux_add_consumer() - receive isochronous packets in the channel via the shared context.
+ * @card: the card to receive packets
+ * @consumer: the consumer with the channel and the callback
+ *
+ * The number of IR contexts is limited by hardware, while the multichannel IR context can receive
+ * packets in any channel. The core shares the multichannel IR context between the consumers of
+ * the card, splits the received packets by channel, and passes them to the callback of consumers
+ * in the channel. Multiple consumers can receive the same channel. The multichannel IR context is
+ * allocated and started when the first consumer is added, and released when the last consumer is
+ * removed. Unlike the IR context dedicated to a channel, the packets are not handled before the
+ * page of buffer is filled, unless fw_iso_demux_flush_completions() is called.
+ *
+ * Context: Process context.
+ *
+ * Return: 0 on success, -EINVAL if the channel is invalid, -EBUSY if the multichannel IR context is
+ * used by the others or the channel is received by the other IR context, or negative error code.
+ */
+int fw_iso_demux_add_consumer(struct fw_card *card, struct fw_iso_demux_consumer *consumer)
+{
+	struct fw_iso_demux *demux;
+	u64 channels;
+	int err;
+
+	if (consumer->channel < 0 || consumer->channel >= 64 || !consumer->callback)
+		return -EINVAL;
+
+	guard(mutex)(&iso_demux_mutex);
+
+	demux = card->iso_demux;
+	if (!demux) {
+		demux = iso_demux_create(card);
+		if (IS_ERR(demux))
+			return PTR_ERR(demux);
+		WRITE_ONCE(card->iso_demux, demux);
+	}
+
+	channels = demux->channels | BIT_ULL(consumer->channel);
+	if (channels != demux->channels) {
+		err = fw_iso_context_set_channels(demux->context, &channels);
+		if (err < 0) {
+			if (demux->channels == 0) {
+				iso_demux_destroy(demux, card);
+				WRITE_ONCE(card->iso_demux, NULL);
+			}
+			return err;
+		}
+		demux->channels = channels;
+	}
+
+	scoped_guard(spinlock, &demux->lock)
+		list_add_tail(&consumer->link, &demux->consumers[consumer->channel]);
+
+	return 0;
+}
+EXPORT_SYMBOL(fw_iso_demux_add_consumer);
+
+/**
+ * fw_iso_demux_remove_consumer() - stop receiving isochronous packets via the shared context.
+ * @card: the card to receive packets
+ * @consumer: the consumer added by fw_iso_demux_add_consumer()
+ *
+ * The callback of the consumer is never called once this function returns.
+ *
+ * Context: Process context. May sleep to release the multichannel IR context.
+ */
+void fw_iso_demux_remove_consumer(struct fw_card *card, struct fw_iso_demux_consumer *consumer)
+{
+	struct fw_iso_demux *demux;
+	u64 channels;
+	bool unused;
+
+	guard(mutex)(&iso_demux_mutex);
+
+	demux = card->iso_demux;
+	if (WARN_ON(!demux))
+		return;
+
+	scoped_guard(spinlock, &demux->lock) {
+		list_del(&consumer->link);
+		unused = list_empty(&demux->consumers[consumer->channel]);
+	}
+	if (!unused)
+		return;
+
+	channels = demux->channels & ~BIT_ULL(consumer->channel);
+	if (channels == 0) {
+		iso_demux_destroy(demux, card);
+		WRITE_ONCE(card->iso_demux, NULL);
+		return;
+	}
+
+	// Removing channels never fails.
+	fw_iso_context_set_channels(demux->context, &channels);
+	demux->channels = channels;
+}
+EXPORT_SYMBOL(fw_iso_demux_remove_consumer);
+
+/**
+ * fw_iso_demux_flush_completions() - process the packets received via the shared context so far.
+ * @card: the card to receive packets
+ *
+ * Call the callback of consumers for packets stored in the page of buffer which is not filled yet.
+ * The caller should have a consumer added by fw_iso_demux_add_consumer() and should not hold any
+ * lock which the callback of consumer acquires.
+ *
+ * Context: Process context. May sleep due to fw_iso_context_flush_completions().
+ *
+ * Return: 0 on success, or negative error code.
+ */
+int fw_iso_demux_flush_completions(struct fw_card *card)
+{
+	// The demultiplexer is not released while the caller has a consumer.
+	struct fw_iso_demux *demux = READ_ONCE(card->iso_demux);
+
+	if (WARN_ON(!demux))
+		return -ENODEV;
+
+	return fw_iso_context_flush_completions(demux->context);
+}
+EXPORT_SYMBOL(fw_iso_demux_flush_completions);
+
 /*
  * Isochronous bus resource management (channels, bandwidth), client side
  */
@@ -5,8 +5,10 @@
  * Copyright (C) 2004-2006 Kristian Hoegsberg <krh@bitplanet.net>
  */
 
+#include <linux/bitops.h>
 #include <linux/bug.h>
 #include <linux/completion.h>
+#include <linux/debugfs.h>
 #include <linux/device.h>
 #include <linux/errno.h>
 #include <linux/firewire.h>
@@ -18,6 +20,8 @@
 #include <linux/list.h>
 #include <linux/module.h>
 #include <linux/rculist.h>
+#include <linux/sched/task_stack.h>
+#include <linux/seq_file.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
@@ -44,25 +48,81 @@ static int try_cancel_split_timeout(struct fw_transaction *t)
 		return 1;
 }
 
-// card->transactions.lock must be acquired in advance.
-static void remove_transaction_entry(struct fw_card *card, struct fw_transaction *entry)
+static struct fw_transaction_pool *transaction_pool(struct fw_card *card, int node_id)
 {
-	list_del_init(&entry->link);
-	card->transactions.tlabel_mask &= ~(1ULL << entry->tlabel);
+	// The pool is per destination node in the local bus.
+	return &card->transactions.pools[node_id & 0x3f];
 }
 
-// Must be called without holding card->transactions.lock.
+static void lock_transaction_pool(struct fw_transaction_pool *pool, unsigned long *flags)
+__acquires(&pool->lock)
+{
+	if (spin_trylock_irqsave(&pool->lock, *flags))
+		return;
+
+	atomic_long_inc(&pool->contended);
+	spin_lock_irqsave(&pool->lock, *flags);
+}
+
+// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for local
+// destination never runs in any type of IRQ context.
+DEFINE_LOCK_GUARD_1(transaction_pool, struct fw_transaction_pool,
+		    lock_transaction_pool(_T->lock, &_T->flags),
+		    spin_unlock_irqrestore(&_T->lock->lock, _T->flags),
+		    unsigned long flags)
+
+// pool->lock must be acquired in advance.
+static void add_transaction_entry(struct fw_transaction_pool *pool, struct fw_transaction *entry)
+{
+	pool->by_tlabel[entry->tlabel] = entry;
+}
+
+// pool->lock must be acquired in advance. The transaction is removed from the table once
+// completed or cancelled.
+static bool has_transaction_entry(struct fw_transaction_pool *pool, struct fw_transaction *entry)
+{
+	return pool->by_tlabel[entry->tlabel] == entry;
+}
+
+// pool->lock must be acquired in advance.
+static void release_tlabel(struct fw_card *card, struct fw_transaction_pool *pool, int tlabel)
+{
+	pool->tlabel_mask &= ~(1ULL << tlabel);
+
+	if (wq_has_sleeper(&card->transactions.tlabel_wait))
+		wake_up(&card->transactions.tlabel_wait);
+}
+
+// pool->lock must be acquired in advance.
+static void remove_transaction_entry(struct fw_card *card, struct fw_transaction_pool *pool,
+				     struct fw_transaction *entry)
+{
+	pool->by_tlabel[entry->tlabel] = NULL;
+	release_tlabel(card, pool, entry->tlabel);
+}
+
+// Must be called without holding the lock of any pool.
 void fw_cancel_pending_transactions(struct fw_card *card)
 {
 	struct fw_transaction *t, *tmp;
 	LIST_HEAD(pending_list);
 
-	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-	// local destination never runs in any type of IRQ context.
-	scoped_guard(spinlock_irqsave, &card->transactions.lock) {
-		list_for_each_entry_safe(t, tmp, &card->transactions.list, link) {
-			if (try_cancel_split_timeout(t))
-				list_move(&t->link, &pending_list);
+	for (int i = 0; i < ARRAY_SIZE(card->transactions.pools); ++i) {
+		struct fw_transaction_pool *pool = &card->transactions.pools[i];
+
+		scoped_guard(transaction_pool, pool) {
+			u64 mask = pool->tlabel_mask;
+
+			while (mask) {
+				int tlabel = __ffs64(mask);
+
+				mask &= mask - 1;
+				t = pool->by_tlabel[tlabel];
+				if (t && try_cancel_split_timeout(t)) {
+					list_add_tail(&t->link, &pending_list);
+					remove_transaction_entry(card, pool, t);
+				}
+			}
 		}
 	}
 
@@ -79,32 +139,83 @@ void fw_cancel_pending_transactions(struct fw_card *card)
 	}
 }
 
-// card->transactions.lock must be acquired in advance.
-#define find_and_pop_transaction_entry(card, condition)			\
-({									\
-	struct fw_transaction *iter, *t = NULL;				\
-	list_for_each_entry(iter, &card->transactions.list, link) {	\
-		if (condition) {					\
-			t = iter;					\
-			break;						\
-		}							\
-	}								\
-	if (t && try_cancel_split_timeout(t))				\
-		remove_transaction_entry(card, t);			\
-	t;								\
-})
+bool fw_has_pending_transactions(struct fw_card *card)
+{
+	for (int i = 0; i < ARRAY_SIZE(card->transactions.pools); ++i) {
+		struct fw_transaction_pool *pool = &card->transactions.pools[i];
+
+		guard(transaction_pool)(pool);
+
+		if (pool->tlabel_mask)
+			return true;
+	}
+
+	return false;
+}
+
+static int transactions_show(struct seq_file *m, void *data)
+{
+	struct fw_card *card = m->private;
+
+	seq_puts(m, "node outstanding contended\n");
+	for (int i = 0; i < ARRAY_SIZE(card->transactions.pools); ++i) {
+		struct fw_transaction_pool *pool = &card->transactions.pools[i];
+		long contended = atomic_long_read(&pool->contended);
+		unsigned int outstanding;
+
+		scoped_guard(transaction_pool, pool)
+			outstanding = hweight64(pool->tlabel_mask);
+
+		if (outstanding > 0 || contended > 0)
+			seq_printf(m, "%4d %11u %9ld\n", i, outstanding, contended);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(transactions);
+
+// The entry is removed together with the directory of card.
+void fw_transactions_debugfs_init(struct fw_card *card)
+{
+	debugfs_create_file("transactions", 0444, card->debugfs_dir, card, &transactions_fops);
+}
+
+// pool->lock must be acquired in advance.
+static struct fw_transaction *find_transaction_entry(struct fw_transaction_pool *pool, int node_id,
+						     int tlabel)
+{
+	struct fw_transaction *t;
+
+	if (!(pool->tlabel_mask & (1ULL << tlabel)))
+		return NULL;
+
+	t = pool->by_tlabel[tlabel];
+	if (!t || t->node_id != node_id)
+		return NULL;
+
+	return t;
+}
+
+// pool->lock must be acquired in advance.
+static struct fw_transaction *pop_transaction_entry(struct fw_card *card,
+						    struct fw_transaction_pool *pool,
+						    struct fw_transaction *t)
+{
+	if (t && try_cancel_split_timeout(t))
+		remove_transaction_entry(card, pool, t);
+	return t;
+}
 
 static int close_transaction(struct fw_transaction *transaction, struct fw_card *card, int rcode,
 			     u32 response_tstamp)
 {
+	struct fw_transaction_pool *pool = transaction_pool(card, transaction->node_id);
 	struct fw_transaction *t;
 
-	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-	// local destination never runs in any type of IRQ context.
-	scoped_guard(spinlock_irqsave, &card->transactions.lock) {
-		t = find_and_pop_transaction_entry(card, iter == transaction);
-		if (!t)
+	scoped_guard(transaction_pool, pool) {
+		if (!has_transaction_entry(pool, transaction))
 			return -ENOENT;
+		t = pop_transaction_entry(card, pool, transaction);
 	}
 
 	if (!t->with_tstamp) {
@@ -158,11 +269,12 @@ static void split_transaction_timeout_callback(struct timer_list *timer)
 {
 	struct fw_transaction *t = timer_container_of(t, timer, split_timeout_timer);
 	struct fw_card *card = t->card;
+	struct fw_transaction_pool *pool = transaction_pool(card, t->node_id);
 
-	scoped_guard(spinlock_irqsave, &card->transactions.lock) {
-		if (list_empty(&t->link))
+	scoped_guard(transaction_pool, pool) {
+		if (!has_transaction_entry(pool, t))
 			return;
-		remove_transaction_entry(card, t);
+		remove_transaction_entry(card, pool, t);
 	}
 
 	if (!t->with_tstamp) {
@@ -173,10 +285,11 @@ static void split_transaction_timeout_callback(struct timer_list *timer)
 	}
 }
 
-// card->transactions.lock should be acquired in advance for the linked list.
-static void start_split_transaction_timeout(struct fw_transaction *t, unsigned int delta)
+// The lock of pool should be acquired in advance for the table.
+static void start_split_transaction_timeout(struct fw_transaction_pool *pool,
+					    struct fw_transaction *t, unsigned int delta)
 {
-	if (list_empty(&t->link) || WARN_ON(t->is_split_transaction))
+	if (!has_transaction_entry(pool, t) || WARN_ON(t->is_split_transaction))
 		return;
 
 	t->is_split_transaction = true;
@@ -201,6 +314,7 @@ static void transmit_complete_callback(struct fw_packet *packet,
 		break;
 	case ACK_PENDING:
 	{
+		struct fw_transaction_pool *pool = transaction_pool(card, t->node_id);
 		unsigned int delta;
 
 		// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
@@ -211,10 +325,8 @@ static void transmit_complete_callback(struct fw_packet *packet,
 			delta = card->split_timeout.jiffies;
 		}
 
-		// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-		// local destination never runs in any type of IRQ context.
-		scoped_guard(spinlock_irqsave, &card->transactions.lock)
-			start_split_transaction_timeout(t, delta);
+		scoped_guard(transaction_pool, pool)
+			start_split_transaction_timeout(pool, t, delta);
 		break;
 	}
 	case ACK_BUSY_X:
@@ -308,26 +420,120 @@ static void fw_fill_request(struct fw_packet *packet, int tcode, int tlabel,
 	packet->payload_mapped = false;
 }
 
-static int allocate_tlabel(struct fw_card *card)
-__must_hold(&card->transactions_lock)
+static int allocate_tlabel(struct fw_transaction_pool *pool)
+__must_hold(&pool->lock)
 {
 	int tlabel;
 
-	lockdep_assert_held(&card->transactions.lock);
+	lockdep_assert_held(&pool->lock);
 
-	tlabel = card->transactions.current_tlabel;
-	while (card->transactions.tlabel_mask & (1ULL << tlabel)) {
+	tlabel = pool->current_tlabel;
+	while (pool->tlabel_mask & (1ULL << tlabel)) {
 		tlabel = (tlabel + 1) & 0x3f;
-		if (tlabel == card->transactions.current_tlabel)
+		if (tlabel == pool->current_tlabel)
 			return -EBUSY;
 	}
 
-	card->transactions.current_tlabel = (tlabel + 1) & 0x3f;
-	card->transactions.tlabel_mask |= 1ULL << tlabel;
+	pool->current_tlabel = (tlabel + 1) & 0x3f;
+	pool->tlabel_mask |= 1ULL << tlabel;
+
+	return tlabel;
+}
+
+static int try_allocate_tlabel(struct fw_card *card, int destination_id)
+{
+	struct fw_transaction_pool *pool = transaction_pool(card, destination_id);
+
+	guard(transaction_pool)(pool);
+
+	return allocate_tlabel(pool);
+}
+
+// Wait for any tlabel to be released for the destination when all of them are in use.
+static int wait_for_tlabel(struct fw_card *card, int destination_id)
+{
+	int tlabel;
+	int err;
+
+	might_sleep();
+
+	err = wait_event_killable(card->transactions.tlabel_wait,
+				  (tlabel = try_allocate_tlabel(card, destination_id)) >= 0);
+	if (err < 0)
+		return err;
 
 	return tlabel;
 }
 
+// Put the transaction on the table with the tlabel allocated in advance, or allocate it if the
+// given tlabel is negative, then fill the request packet. -EBUSY is returned if no tlabel is
+// available. In the case, the callback is called with RCODE_SEND_ERROR as well if notify_busy is
+// true.
+static int prepare_request(struct fw_card *card, struct fw_transaction *t, int tcode,
+		int destination_id, int generation, int speed, unsigned long long offset,
+		void *payload, size_t length, union fw_transaction_callback callback,
+		bool with_tstamp, void *callback_data, int tlabel, bool notify_busy)
+{
+	struct fw_transaction_pool *pool = transaction_pool(card, destination_id);
+
+	INIT_LIST_HEAD(&t->link);
+
+	t->node_id = destination_id;
+	t->card = card;
+	t->is_split_transaction = false;
+	timer_setup(&t->split_timeout_timer, split_transaction_timeout_callback, 0);
+	t->callback = callback;
+	t->with_tstamp = with_tstamp;
+	t->callback_data = callback_data;
+	t->packet.callback = transmit_complete_callback;
+
+	/*
+	 * Allocate tlabel from the bitmap and put the transaction on
+	 * the table while holding the spinlock of pool for the destination.
+	 */
+	scoped_guard(transaction_pool, pool) {
+		if (tlabel < 0)
+			tlabel = allocate_tlabel(pool);
+		if (tlabel >= 0) {
+			t->tlabel = tlabel;
+			add_transaction_entry(pool, t);
+		}
+	}
+	if (tlabel < 0) {
+		if (!notify_busy) {
+			return -EBUSY;
+		} else if (!with_tstamp) {
+			callback.without_tstamp(card, RCODE_SEND_ERROR, NULL, 0, callback_data);
+		} else {
+			// Timestamping on behalf of hardware.
+			u32 curr_cycle_time = 0;
+			u32 tstamp;
+
+			(void)fw_card_read_cycle_time(card, &curr_cycle_time);
+			tstamp = cycle_time_to_ohci_tstamp(curr_cycle_time);
+
+			callback.with_tstamp(card, RCODE_SEND_ERROR, tstamp, tstamp, NULL, 0,
+					     callback_data);
+		}
+		return -EBUSY;
+	}
+
+	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
+	// local destination never runs in any type of IRQ context.
+	scoped_guard(spinlock_irqsave, &card->lock) {
+		// The node_id field of fw_card can be updated when handling SelfIDComplete.
+		fw_fill_request(&t->packet, tcode, t->tlabel, destination_id, card->node_id,
+				generation, speed, offset, payload, length);
+	}
+
+	// Safe with no lock, since the index field of fw_card is immutable once assigned.
+	trace_async_request_outbound_initiate((uintptr_t)t, card->index, generation, speed,
+					      t->packet.header, payload,
+					      tcode_is_read_request(tcode) ? 0 : length / 4);
+
+	return 0;
+}
+
 /**
  * __fw_send_request() - submit a request packet for transmission to generate callback for response
  *			 subaction with or without time stamp.
@@ -349,6 +555,11 @@ __must_hold(&card->transactions_lock)
  * Can be called from atomic context.  If you prefer a blocking API, use
  * fw_run_transaction() in a context that can sleep.
  *
+ * The tlabel is allocated from the pool for @destination_id.  When all of 64
+ * tlabels for the destination are in use, @callback is called with
+ * %RCODE_SEND_ERROR immediately.  fw_run_transaction() waits for a tlabel
+ * instead.
+ *
  * In case of lock requests, specify one of the firewire-core specific %TCODE_
  * constants instead of %TCODE_LOCK_REQUEST in @tcode.
  *
@@ -384,65 +595,84 @@ void __fw_send_request(struct fw_card *card, struct fw_transaction *t, int tcode
 		void *payload, size_t length, union fw_transaction_callback callback,
 		bool with_tstamp, void *callback_data)
 {
-	int tlabel;
+	if (prepare_request(card, t, tcode, destination_id, generation, speed, offset, payload,
+			    length, callback, with_tstamp, callback_data, -1, true) >= 0)
+		card->driver->send_request(card, &t->packet);
+}
+EXPORT_SYMBOL_GPL(__fw_send_request);
 
-	/*
-	 * Allocate tlabel from the bitmap and put the transaction on
-	 * the list while holding the card spinlock.
-	 */
+/**
+ * __fw_queue_request() - prepare a request packet and queue it to the given list for batched
+ *			  submission.
+ * @card:		interface to send the request at
+ * @t:			transaction instance to which the request belongs
+ * @tcode:		transaction code
+ * @destination_id:	destination node ID, consisting of bus_ID and phy_ID
+ * @generation:		bus generation in which request and response are valid
+ * @speed:		transmission speed
+ * @offset:		48bit wide offset into destination's address space
+ * @payload:		data payload for the request subaction
+ * @length:		length of the payload, in bytes
+ * @callback:		union of two functions whether to receive time stamp or not for response
+ *			subaction.
+ * @with_tstamp:	Whether to receive time stamp or not for response subaction.
+ * @callback_data:	data to be passed to the transaction completion callback
+ * @packets:		list to which the request packet is appended
+ *
+ * The same as __fw_send_request() except that the request packet is not submitted yet. The
+ * requests queued to @packets should be submitted by fw_send_queued_requests() in the same order,
+ * so that the underlying driver can link them into the DMA program at once and notify the
+ * controller just once.
+ *
+ * The transaction is already visible to response handling once this function returns, thus
+ * fw_send_queued_requests() should be called shortly.
+ *
+ * Return: 0 if the request is appended to @packets, or -EBUSY if no tlabel is available for
+ * @destination_id. In the latter case, @callback is not called and the caller can retry after any
+ * of outstanding transactions to the destination is completed.
+ */
+int __fw_queue_request(struct fw_card *card, struct fw_transaction *t, int tcode,
+		int destination_id, int generation, int speed, unsigned long long offset,
+		void *payload, size_t length, union fw_transaction_callback callback,
+		bool with_tstamp, void *callback_data, struct list_head *packets)
+{
+	int err;
 
-	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-	// local destination never runs in any type of IRQ context.
-	scoped_guard(spinlock_irqsave, &card->transactions.lock)
-		tlabel = allocate_tlabel(card);
-	if (tlabel < 0) {
-		if (!with_tstamp) {
-			callback.without_tstamp(card, RCODE_SEND_ERROR, NULL, 0, callback_data);
-		} else {
-			// Timestamping on behalf of hardware.
-			u32 curr_cycle_time = 0;
-			u32 tstamp;
+	err = prepare_request(card, t, tcode, destination_id, generation, speed, offset, payload,
+			      length, callback, with_tstamp, callback_data, -1, false);
+	if (err < 0)
+		return err;
+	list_add_tail(&t->packet.link, packets);
 
-			(void)fw_card_read_cycle_time(card, &curr_cycle_time);
-			tstamp = cycle_time_to_ohci_tstamp(curr_cycle_time);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(__fw_queue_request);
 
-			callback.with_tstamp(card, RCODE_SEND_ERROR, tstamp, tstamp, NULL, 0,
-					     callback_data);
-		}
+/**
+ * fw_send_queued_requests() - submit request packets queued by __fw_queue_request()
+ * @card:	interface to send the requests at
+ * @packets:	list of request packets
+ *
+ * Submit all of request packets in @packets into the asynchronous request transmission queue at
+ * once. Can be called from atomic context. The list is empty when the function returns.
+ */
+void fw_send_queued_requests(struct fw_card *card, struct list_head *packets)
+{
+	if (list_empty(packets))
 		return;
-	}
 
-	t->node_id = destination_id;
-	t->tlabel = tlabel;
-	t->card = card;
-	t->is_split_transaction = false;
-	timer_setup(&t->split_timeout_timer, split_transaction_timeout_callback, 0);
-	t->callback = callback;
-	t->with_tstamp = with_tstamp;
-	t->callback_data = callback_data;
-	t->packet.callback = transmit_complete_callback;
+	// A single request gains nothing from batching.
+	if (list_is_singular(packets)) {
+		struct fw_packet *packet = list_first_entry(packets, struct fw_packet, link);
 
-	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-	// local destination never runs in any type of IRQ context.
-	scoped_guard(spinlock_irqsave, &card->lock) {
-		// The node_id field of fw_card can be updated when handling SelfIDComplete.
-		fw_fill_request(&t->packet, tcode, t->tlabel, destination_id, card->node_id,
-				generation, speed, offset, payload, length);
+		list_del_init(&packet->link);
+		card->driver->send_request(card, packet);
+		return;
 	}
 
-	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-	// local destination never runs in any type of IRQ context.
-	scoped_guard(spinlock_irqsave, &card->transactions.lock)
-		list_add_tail(&t->link, &card->transactions.list);
-
-	// Safe with no lock, since the index field of fw_card is immutable once assigned.
-	trace_async_request_outbound_initiate((uintptr_t)t, card->index, generation, speed,
-					      t->packet.header, payload,
-					      tcode_is_read_request(tcode) ? 0 : length / 4);
-
-	card->driver->send_request(card, &t->packet);
+	card->driver->send_requests(card, packets);
 }
-EXPORT_SYMBOL_GPL(__fw_send_request);
+EXPORT_SYMBOL_GPL(fw_send_queued_requests);
 
 struct transaction_callback_data {
 	struct completion done;
@@ -476,19 +706,32 @@ static void transaction_callback(struct fw_card *card, int rcode,
  * Unlike fw_send_request(), @data points to the payload of the request or/and
  * to the payload of the response.  DMA mapping restrictions apply to outbound
  * request payloads of >= 8 bytes but not to inbound response payloads.
+ *
+ * Unlike fw_send_request(), the call waits for any tlabel to be released when
+ * all of tlabels for the destination are in use, instead of failure with
+ * %RCODE_SEND_ERROR. %RCODE_CANCELLED is returned if a fatal signal is received
+ * while waiting.
  */
 int fw_run_transaction(struct fw_card *card, int tcode, int destination_id,
 		       int generation, int speed, unsigned long long offset,
 		       void *payload, size_t length)
 {
+	union fw_transaction_callback callback = { .without_tstamp = transaction_callback };
 	struct transaction_callback_data d;
 	struct fw_transaction t;
+	int tlabel;
+
+	// Unlike the case of atomic context, wait for tlabel instead of failure.
+	tlabel = wait_for_tlabel(card, destination_id);
+	if (tlabel < 0)
+		return RCODE_CANCELLED;
 
 	timer_setup_on_stack(&t.split_timeout_timer, NULL, 0);
 	init_completion(&d.done);
 	d.payload = payload;
-	fw_send_request(card, &t, tcode, destination_id, generation, speed,
-			offset, payload, length, transaction_callback, &d);
+	if (prepare_request(card, &t, tcode, destination_id, generation, speed, offset, payload,
+			    length, callback, false, &d, tlabel, true) >= 0)
+		card->driver->send_request(card, &t.packet);
 	wait_for_completion(&d.done);
 	timer_destroy_on_stack(&t.split_timeout_timer);
 
@@ -496,6 +739,268 @@ int fw_run_transaction(struct fw_card *card, int tcode, int destination_id,
 }
 EXPORT_SYMBOL(fw_run_transaction);
 
+// batch->lock must be acquired in advance. The batch is completed when all of requests are
+// completed and no one submits requests anymore.
+static bool is_request_batch_completed(const struct fw_request_batch *batch)
+{
+	return batch->completed == batch->count && !batch->submitting;
+}
+
+static void submit_request_batch(struct fw_request_batch *batch);
+
+static void batch_transaction_callback(struct fw_card *card, int rcode, void *payload,
+				       size_t length, void *data)
+{
+	struct fw_batch_request *request = data;
+	struct fw_request_batch *batch = request->batch;
+	bool completed;
+
+	if (rcode == RCODE_COMPLETE)
+		memcpy(request->payload, payload, length);
+	request->rcode = rcode;
+
+	scoped_guard(spinlock_irqsave, &batch->lock) {
+		--batch->inflight;
+		++batch->completed;
+		completed = is_request_batch_completed(batch);
+	}
+
+	if (completed)
+		batch->callback(card, batch->requests, batch->count, batch->callback_data);
+	else
+		submit_request_batch(batch);
+}
+
+// Submit the pending requests as long as tlabels are available for the destination. The
+// submission is done by single caller at a time, since the callback of transaction can be called
+// during the submission and resubmit requests.
+static void submit_request_batch(struct fw_request_batch *batch)
+{
+	union fw_transaction_callback callback = { .without_tstamp = batch_transaction_callback };
+	struct fw_card *card = batch->card;
+	bool resubmit, completed = false, starved = false;
+
+	scoped_guard(spinlock_irqsave, &batch->lock) {
+		if (batch->submitting) {
+			batch->resubmit = true;
+			return;
+		}
+		batch->submitting = true;
+	}
+
+	do {
+		LIST_HEAD(packets);
+
+		while (batch->next < batch->count) {
+			struct fw_batch_request *request = batch->requests + batch->next;
+			bool inflight;
+			int tlabel;
+
+			if (batch->tlabel >= 0) {
+				tlabel = batch->tlabel;
+				batch->tlabel = -1;
+			} else {
+				tlabel = try_allocate_tlabel(card, batch->destination_id);
+			}
+
+			scoped_guard(spinlock_irqsave, &batch->lock) {
+				inflight = batch->inflight > 0;
+				if (tlabel >= 0)
+					++batch->inflight;
+				else if (!inflight && batch->may_wait)
+					batch->starved = true;
+				else if (!inflight)
+					++batch->completed;
+			}
+
+			if (tlabel < 0) {
+				// Any completion of the batch resumes the submission.
+				if (inflight)
+					break;
+				// The waiter resumes the submission with the tlabel released by the
+				// others.
+				if (batch->may_wait) {
+					starved = true;
+					break;
+				}
+				// The tlabels are exhausted by the others.
+				request->rcode = RCODE_SEND_ERROR;
+				++batch->next;
+				continue;
+			}
+
+			++batch->next;
+			if (prepare_request(card, &request->transaction, request->tcode,
+					    batch->destination_id, batch->generation, batch->speed,
+					    request->offset, request->payload, request->length,
+					    callback, false, request, tlabel, true) >= 0)
+				list_add_tail(&request->transaction.packet.link, &packets);
+		}
+
+		fw_send_queued_requests(card, &packets);
+
+		scoped_guard(spinlock_irqsave, &batch->lock) {
+			resubmit = batch->resubmit;
+			batch->resubmit = false;
+			if (!resubmit) {
+				batch->submitting = false;
+				completed = is_request_batch_completed(batch);
+			}
+		}
+	} while (resubmit);
+
+	if (completed || starved)
+		batch->callback(card, batch->requests, batch->count, batch->callback_data);
+}
+
+/**
+ * fw_send_request_batch() - submit a batch of request packets to the same destination
+ * @card:		interface to send the requests at
+ * @batch:		the state of batch, kept by the caller until the completion
+ * @destination_id:	destination node ID, consisting of bus_ID and phy_ID
+ * @generation:		bus generation in which requests and responses are valid
+ * @speed:		transmission speed
+ * @requests:		the array of requests with tcode, offset, payload, and length
+ * @count:		the number of elements in @requests
+ * @callback:		function to be called once when all of transactions are completed
+ * @callback_data:	data to be passed to @callback
+ *
+ * Submit the requests in @requests in order, as many as the tlabels available for
+ * @destination_id, and submit the rest as the outstanding transactions are completed. Thus the
+ * round trips of transactions overlap each other. The requests submitted at once are queued to
+ * the underlying driver at once.
+ *
+ * As fw_run_transaction(), @payload of each request points to the payload of the request or/and
+ * to the buffer for the payload of the response. When all of transactions are completed,
+ * @callback is called with the rcode of each transaction filled in @requests. A request fails with
+ * %RCODE_SEND_ERROR when no tlabel is available and no transaction of the batch is outstanding.
+ *
+ * Can be called from atomic context. @batch and @requests must not be freed before @callback is
+ * called. @callback can be called even before the function returns.
+ */
+static void init_request_batch(struct fw_request_batch *batch, struct fw_card *card,
+			       int destination_id, int generation, int speed,
+			       struct fw_batch_request *requests, unsigned int count,
+			       fw_request_batch_callback_t callback, void *callback_data)
+{
+	batch->card = card;
+	batch->destination_id = destination_id;
+	batch->generation = generation;
+	batch->speed = speed;
+	batch->requests = requests;
+	batch->count = count;
+	batch->next = 0;
+	batch->inflight = 0;
+	batch->completed = 0;
+	batch->submitting = false;
+	batch->resubmit = false;
+	batch->may_wait = false;
+	batch->starved = false;
+	batch->tlabel = -1;
+	spin_lock_init(&batch->lock);
+	batch->callback = callback;
+	batch->callback_data = callback_data;
+
+	for (unsigned int i = 0; i < count; ++i)
+		requests[i].batch = batch;
+}
+
+void fw_send_request_batch(struct fw_card *card, struct fw_request_batch *batch,
+			   int destination_id, int generation, int speed,
+			   struct fw_batch_request *requests, unsigned int count,
+			   fw_request_batch_callback_t callback, void *callback_data)
+{
+	init_request_batch(batch, card, destination_id, generation, speed, requests, count,
+			   callback, callback_data);
+
+	if (count == 0) {
+		callback(card, requests, 0, callback_data);
+		return;
+	}
+
+	submit_request_batch(batch);
+}
+EXPORT_SYMBOL_GPL(fw_send_request_batch);
+
+static void request_batch_callback(struct fw_card *card, struct fw_batch_request *requests,
+				   unsigned int count, void *callback_data)
+{
+	complete(callback_data);
+}
+
+/**
+ * fw_run_request_batch() - submit a batch of request packets and sleep until all of them are
+ *			    completed
+ * @card:		interface to send the requests at
+ * @destination_id:	destination node ID, consisting of bus_ID and phy_ID
+ * @generation:		bus generation in which requests and responses are valid
+ * @speed:		transmission speed
+ * @requests:		the array of requests with tcode, offset, payload, and length
+ * @count:		the number of elements in @requests
+ *
+ * The blocking variation of fw_send_request_batch(). The rcode of each transaction is filled in
+ * @requests when the function returns.
+ *
+ * As fw_run_transaction(), the call waits for any tlabel to be released when all of tlabels for
+ * the destination are in use by the others, instead of failure with %RCODE_SEND_ERROR. The
+ * requests not submitted yet fail with %RCODE_CANCELLED if a fatal signal is received while
+ * waiting.
+ */
+void fw_run_request_batch(struct fw_card *card, int destination_id, int generation, int speed,
+			  struct fw_batch_request *requests, unsigned int count)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct fw_request_batch batch;
+	bool on_stack = object_is_on_stack(requests);
+	unsigned int i;
+
+	might_sleep();
+
+	if (count == 0)
+		return;
+
+	init_request_batch(&batch, card, destination_id, generation, speed, requests, count,
+			   request_batch_callback, &done);
+	batch.may_wait = true;
+
+	if (on_stack) {
+		for (i = 0; i < count; ++i)
+			timer_setup_on_stack(&requests[i].transaction.split_timeout_timer, NULL, 0);
+	}
+
+	while (true) {
+		bool starved;
+		int tlabel;
+
+		submit_request_batch(&batch);
+		wait_for_completion(&done);
+
+		// Nothing is in flight and no one submits requests when the batch is starved.
+		scoped_guard(spinlock_irqsave, &batch.lock) {
+			starved = batch.starved;
+			batch.starved = false;
+		}
+		if (!starved)
+			break;
+
+		// Unlike the case of atomic context, wait for tlabel instead of failure.
+		tlabel = wait_for_tlabel(card, destination_id);
+		if (tlabel < 0) {
+			for (i = batch.next; i < count; ++i)
+				requests[i].rcode = RCODE_CANCELLED;
+			break;
+		}
+		batch.tlabel = tlabel;
+		reinit_completion(&done);
+	}
+
+	if (on_stack) {
+		for (i = 0; i < count; ++i)
+			timer_destroy_on_stack(&requests[i].transaction.split_timeout_timer);
+	}
+}
+EXPORT_SYMBOL_GPL(fw_run_request_batch);
+
 static DEFINE_MUTEX(phy_config_mutex);
 static DECLARE_COMPLETION(phy_config_done);
 
@@ -555,12 +1060,62 @@ void fw_send_phy_config(struct fw_card *card,
 	wait_for_completion_timeout(&phy_config_done, timeout);
 }
 
+static bool is_enclosing_handler(struct fw_address_handler *handler,
+				 unsigned long long offset, size_t length)
+{
+	return handler->offset <= offset &&
+		offset + length <= handler->offset + handler->length;
+}
+
+// The handlers for exclusive regions are never overlapping each other. They are kept in the array
+// sorted by offset, to be looked up by binary search in RCU read-side critical section. The array
+// is replaced with a new copy when adding or removing handler in process context, which is rare.
+struct address_handler_table {
+	struct rcu_head rcu;
+	unsigned int count;
+	struct fw_address_handler *handlers[] __counted_by(count);
+};
+
+static DEFINE_MUTEX(address_handler_lock);
+static struct address_handler_table __rcu *address_handler_table;
+// The handlers for FCP region can be overlapping each other, thus they are in the list.
+static LIST_HEAD(fcp_handler_list);
+
+// The number of handlers whose offset is less than the given one.
+static unsigned int count_address_handlers_below(const struct address_handler_table *table,
+						 unsigned long long offset)
+{
+	unsigned int low = 0, high = table ? table->count : 0;
+
+	while (low < high) {
+		unsigned int mid = low + (high - low) / 2;
+
+		if (table->handlers[mid]->offset < offset)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	return low;
+}
+
 static struct fw_address_handler *lookup_overlapping_address_handler(
-	struct list_head *list, unsigned long long offset, size_t length)
+	const struct address_handler_table *table, unsigned long long offset, size_t length)
 {
 	struct fw_address_handler *handler;
+	unsigned int index;
+
+	// The handler with the largest offset below the end of the given range. The ends of
+	// handlers are in the same order as the offsets.
+	index = count_address_handlers_below(table, offset + length);
+	if (index > 0) {
+		handler = table->handlers[index - 1];
+		if (offset < handler->offset + handler->length)
+			return handler;
+	}
 
-	list_for_each_entry_rcu(handler, list, link) {
+	list_for_each_entry_rcu(handler, &fcp_handler_list, link,
+				lockdep_is_held(&address_handler_lock)) {
 		if (handler->offset < offset + length &&
 		    offset < handler->offset + handler->length)
 			return handler;
@@ -569,29 +1124,58 @@ static struct fw_address_handler *lookup_overlapping_address_handler(
 	return NULL;
 }
 
-static bool is_enclosing_handler(struct fw_address_handler *handler,
-				 unsigned long long offset, size_t length)
+static struct fw_address_handler *lookup_enclosing_address_handler(
+	const struct address_handler_table *table, unsigned long long offset, size_t length)
 {
-	return handler->offset <= offset &&
-		offset + length <= handler->offset + handler->length;
+	struct fw_address_handler *handler;
+	unsigned int index;
+
+	index = count_address_handlers_below(table, offset + 1);
+	if (index == 0)
+		return NULL;
+
+	handler = table->handlers[index - 1];
+	if (!is_enclosing_handler(handler, offset, length))
+		return NULL;
+
+	return handler;
 }
 
-static struct fw_address_handler *lookup_enclosing_address_handler(
-	struct list_head *list, unsigned long long offset, size_t length)
+// Return the new table with the handler inserted or removed, without any change to the old one.
+static struct address_handler_table *copy_address_handler_table(
+	const struct address_handler_table *table, struct fw_address_handler *handler, bool insert,
+	gfp_t gfp)
 {
-	struct fw_address_handler *handler;
+	unsigned int count = table ? table->count : 0;
+	unsigned int index = count_address_handlers_below(table, handler->offset);
+	struct address_handler_table *copy;
 
-	list_for_each_entry_rcu(handler, list, link) {
-		if (is_enclosing_handler(handler, offset, length))
-			return handler;
+	if (insert)
+		++count;
+	else
+		--count;
+
+	copy = kmalloc(struct_size(copy, handlers, count), gfp);
+	if (!copy)
+		return NULL;
+	copy->count = count;
+
+	if (index > 0)
+		memcpy(copy->handlers, table->handlers, index * sizeof(copy->handlers[0]));
+	if (insert) {
+		copy->handlers[index] = handler;
+		if (index < count - 1)
+			memcpy(copy->handlers + index + 1, table->handlers + index,
+			       (count - 1 - index) * sizeof(copy->handlers[0]));
+	} else {
+		if (index < count)
+			memcpy(copy->handlers + index, table->handlers + index + 1,
+			       (count - index) * sizeof(copy->handlers[0]));
 	}
 
-	return NULL;
+	return copy;
 }
 
-static DEFINE_SPINLOCK(address_handler_list_lock);
-static LIST_HEAD(address_handler_list);
-
 const struct fw_address_region fw_high_memory_region =
 	{ .start = FW_MAX_PHYSICAL_RANGE, .end = 0xffffe0000000ULL, };
 EXPORT_SYMBOL(fw_high_memory_region);
@@ -649,8 +1233,8 @@ static int put_address_handler(struct fw_address_handler *handler)
 int fw_core_add_address_handler(struct fw_address_handler *handler,
 				const struct fw_address_region *region)
 {
+	struct address_handler_table *table, *copy;
 	struct fw_address_handler *other;
-	int ret = -EBUSY;
 
 	if (region->start & 0xffff000000000003ULL ||
 	    region->start >= region->end ||
@@ -659,28 +1243,42 @@ int fw_core_add_address_handler(struct fw_address_handler *handler,
 	    handler->length == 0)
 		return -EINVAL;
 
-	guard(spinlock)(&address_handler_list_lock);
+	guard(mutex)(&address_handler_lock);
+
+	table = rcu_dereference_protected(address_handler_table,
+					  lockdep_is_held(&address_handler_lock));
 
 	handler->offset = region->start;
 	while (handler->offset + handler->length <= region->end) {
-		if (is_in_fcp_region(handler->offset, handler->length))
-			other = NULL;
-		else
-			other = lookup_overlapping_address_handler
-					(&address_handler_list,
-					 handler->offset, handler->length);
-		if (other != NULL) {
-			handler->offset += other->length;
-		} else {
+		if (is_in_fcp_region(handler->offset, handler->length)) {
 			init_completion(&handler->done);
 			kref_init(&handler->kref);
-			list_add_tail_rcu(&handler->link, &address_handler_list);
-			ret = 0;
-			break;
+			list_add_tail_rcu(&handler->link, &fcp_handler_list);
+			return 0;
 		}
+
+		other = lookup_overlapping_address_handler(table, handler->offset,
+							   handler->length);
+		if (other == NULL)
+			break;
+
+		// Skip to the end of the overlapping region. It is quadlet-aligned as well.
+		handler->offset = other->offset + other->length;
 	}
+	if (handler->offset + handler->length > region->end)
+		return -EBUSY;
+
+	copy = copy_address_handler_table(table, handler, true, GFP_KERNEL);
+	if (!copy)
+		return -ENOMEM;
+
+	init_completion(&handler->done);
+	kref_init(&handler->kref);
+	rcu_assign_pointer(address_handler_table, copy);
+	if (table)
+		kfree_rcu(table, rcu);
 
-	return ret;
+	return 0;
 }
 EXPORT_SYMBOL(fw_core_add_address_handler);
 
@@ -695,11 +1293,27 @@ EXPORT_SYMBOL(fw_core_add_address_handler);
  */
 void fw_core_remove_address_handler(struct fw_address_handler *handler)
 {
-	scoped_guard(spinlock, &address_handler_list_lock)
-		list_del_rcu(&handler->link);
+	struct address_handler_table *table = NULL;
+
+	scoped_guard(mutex, &address_handler_lock) {
+		struct address_handler_table *copy;
+
+		if (is_in_fcp_region(handler->offset, handler->length)) {
+			list_del_rcu(&handler->link);
+		} else {
+			table = rcu_dereference_protected(address_handler_table,
+							  lockdep_is_held(&address_handler_lock));
+			// The allocation for smaller table should not fail in practice.
+			copy = copy_address_handler_table(table, handler, false,
+							  GFP_KERNEL | __GFP_NOFAIL);
+			rcu_assign_pointer(address_handler_table, copy);
+		}
+	}
 
 	synchronize_rcu();
 
+	kfree(table);
+
 	if (!put_address_handler(handler))
 		wait_for_completion(&handler->done);
 }
@@ -712,9 +1326,74 @@ struct fw_request {
 	int ack;
 	u32 timestamp;
 	u32 length;
-	u32 data[];
+	// Point to either the inline storage or the payload buffer lent by the card driver.
+	u32 *data;
+	// Not NULL when the payload buffer is lent by the card driver.
+	struct fw_card *lender;
+	unsigned long lease;
+	// The cache from which the object is allocated, or NULL for kmalloc().
+	struct kmem_cache *cache;
+	u32 inline_data[];
 };
 
+// The size classes of inline storage for inbound requests. The maximum size of payload for
+// asynchronous packet is 4096 bytes at S800.
+static const struct {
+	unsigned int size;
+	const char *name;
+} request_cache_classes[] = {
+	{ 4,	"fw_request_4" },
+	{ 512,	"fw_request_512" },
+	{ 2048,	"fw_request_2048" },
+	{ 4096,	"fw_request_4096" },
+};
+static struct kmem_cache *request_caches[ARRAY_SIZE(request_cache_classes)];
+
+static struct fw_request *alloc_request_storage(unsigned int length)
+{
+	struct fw_request *request;
+
+	for (int i = 0; i < ARRAY_SIZE(request_cache_classes); ++i) {
+		if (length <= request_cache_classes[i].size) {
+			request = kmem_cache_alloc(request_caches[i], GFP_ATOMIC);
+			if (request)
+				request->cache = request_caches[i];
+			return request;
+		}
+	}
+
+	// The request with corrupted header.
+	request = kmalloc(sizeof(*request) + length, GFP_ATOMIC);
+	if (request)
+		request->cache = NULL;
+	return request;
+}
+
+static void destroy_request_caches(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(request_caches); ++i) {
+		kmem_cache_destroy(request_caches[i]);
+		request_caches[i] = NULL;
+	}
+}
+
+static int create_request_caches(void)
+{
+	for (int i = 0; i < ARRAY_SIZE(request_cache_classes); ++i) {
+		request_caches[i] =
+			kmem_cache_create(request_cache_classes[i].name,
+					  struct_size_t(struct fw_request, inline_data,
+							request_cache_classes[i].size / 4),
+					  0, 0, NULL);
+		if (!request_caches[i]) {
+			destroy_request_caches();
+			return -ENOMEM;
+		}
+	}
+
+	return 0;
+}
+
 void fw_request_get(struct fw_request *request)
 {
 	kref_get(&request->kref);
@@ -724,7 +1403,15 @@ static void release_request(struct kref *kref)
 {
 	struct fw_request *request = container_of(kref, struct fw_request, kref);
 
-	kfree(request);
+	if (request->lender) {
+		request->lender->driver->return_payload(request->lender, request->lease);
+		fw_card_put(request->lender);
+	}
+
+	if (request->cache)
+		kmem_cache_free(request->cache, request);
+	else
+		kfree(request);
 }
 
 void fw_request_put(struct fw_request *request)
@@ -855,12 +1542,18 @@ __must_hold(&card->split_timeout.lock)
 	return timestamp;
 }
 
+// The payload of block write request larger than this is not copied when the card driver can lend
+// the buffer of payload.
+#define ZERO_COPY_PAYLOAD_THRESHOLD	256
+
 static struct fw_request *allocate_request(struct fw_card *card,
 					   struct fw_packet *p)
 {
 	struct fw_request *request;
 	u32 *data, length;
 	int request_tcode;
+	unsigned long lease;
+	void *lent = NULL;
 
 	request_tcode = async_header_get_tcode(p->header);
 	switch (request_tcode) {
@@ -888,12 +1581,18 @@ static struct fw_request *allocate_request(struct fw_card *card,
 	default:
 		fw_notice(card, "ERROR - corrupt request received - %08x %08x %08x\n",
 			 p->header[0], p->header[1], p->header[2]);
-		return NULL;
+		return ERR_PTR(-EINVAL);
 	}
 
-	request = kmalloc(sizeof(*request) + length, GFP_ATOMIC);
-	if (request == NULL)
-		return NULL;
+	if (request_tcode == TCODE_WRITE_BLOCK_REQUEST && length > ZERO_COPY_PAYLOAD_THRESHOLD)
+		lent = card->driver->lend_payload(card, p, &lease);
+
+	request = alloc_request_storage(lent ? 0 : length);
+	if (request == NULL) {
+		if (lent)
+			card->driver->return_payload(card, lease);
+		return ERR_PTR(-ENOMEM);
+	}
 	kref_init(&request->kref);
 
 	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
@@ -908,8 +1607,16 @@ static struct fw_request *allocate_request(struct fw_card *card,
 	request->ack = p->ack;
 	request->timestamp = p->timestamp;
 	request->length = length;
-	if (data)
-		memcpy(request->data, data, length);
+	if (lent) {
+		request->data = lent;
+		request->lender = fw_card_get(card);
+		request->lease = lease;
+	} else {
+		request->data = request->inline_data;
+		request->lender = NULL;
+		if (data)
+			memcpy(request->data, data, length);
+	}
 
 	memcpy(request->request_header, p->header, sizeof(p->header));
 
@@ -998,8 +1705,8 @@ static void handle_exclusive_region_request(struct fw_card *card,
 		tcode = 0x10 + async_header_get_extended_tcode(p->header);
 
 	scoped_guard(rcu) {
-		handler = lookup_enclosing_address_handler(&address_handler_list, offset,
-							   request->length);
+		handler = lookup_enclosing_address_handler(rcu_dereference(address_handler_table),
+							   offset, request->length);
 		if (handler)
 			get_address_handler(handler);
 	}
@@ -1050,7 +1757,15 @@ static void handle_fcp_region_request(struct fw_card *card,
 	handlers = buffer_on_kernel_stack;
 	buffer_size = ARRAY_SIZE(buffer_on_kernel_stack);
 	scoped_guard(rcu) {
-		list_for_each_entry_rcu(handler, &address_handler_list, link) {
+		// The handler for exclusive region can enclose the FCP registers as well.
+		handler = lookup_enclosing_address_handler(rcu_dereference(address_handler_table),
+							   offset, request->length);
+		if (handler) {
+			get_address_handler(handler);
+			handlers[count++] = handler;
+		}
+
+		list_for_each_entry_rcu(handler, &fcp_handler_list, link) {
 			if (is_enclosing_handler(handler, offset, request->length)) {
 				if (count >= buffer_size) {
 					int next_size = buffer_size * 2;
@@ -1098,6 +1813,54 @@ static void handle_fcp_region_request(struct fw_card *card,
 	fw_send_response(card, request, RCODE_COMPLETE);
 }
 
+// Statically allocated to be sent when the request can not be handled due to memory pressure.
+static struct {
+	struct fw_packet packet;
+	unsigned long in_flight;
+} busy_response;
+
+static void busy_response_callback(struct fw_packet *packet, struct fw_card *card, int status)
+{
+	trace_async_response_outbound_complete((uintptr_t)&busy_response, card->index,
+					       packet->generation, packet->speed, status,
+					       packet->timestamp);
+
+	clear_bit_unlock(0, &busy_response.in_flight);
+}
+
+// IEEE 1394 has no rcode for busy state. The resource conflict error is the one for the responder
+// to request the requester to retry later.
+static void send_busy_response(struct fw_card *card, struct fw_packet *p)
+{
+	struct fw_packet *response = &busy_response.packet;
+
+	// Unified transaction or broadcast transaction: don't respond.
+	if (p->ack != ACK_PENDING || HEADER_DESTINATION_IS_BROADCAST(p->header))
+		return;
+
+	// Drop the request as ever when the previous one is still in flight.
+	if (test_and_set_bit_lock(0, &busy_response.in_flight))
+		return;
+
+	fw_fill_response(response, p->header, RCODE_CONFLICT_ERROR, NULL, 0);
+
+	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
+	// local destination never runs in any type of IRQ context.
+	scoped_guard(spinlock_irqsave, &card->split_timeout.lock)
+		response->timestamp = compute_split_timeout_timestamp(card, p->timestamp);
+
+	response->speed = p->speed;
+	response->generation = p->generation;
+	response->ack = 0;
+	response->callback = busy_response_callback;
+
+	trace_async_response_outbound_initiate((uintptr_t)&busy_response, card->index,
+					       response->generation, response->speed,
+					       response->header, NULL, 0);
+
+	card->driver->send_response(card, response);
+}
+
 void fw_core_handle_request(struct fw_card *card, struct fw_packet *p)
 {
 	struct fw_request *request;
@@ -1116,8 +1879,9 @@ void fw_core_handle_request(struct fw_card *card, struct fw_packet *p)
 	}
 
 	request = allocate_request(card, p);
-	if (request == NULL) {
-		/* FIXME: send statically allocated busy packet. */
+	if (IS_ERR(request)) {
+		if (PTR_ERR(request) == -ENOMEM)
+			send_busy_response(card, p);
 		return;
 	}
 
@@ -1141,6 +1905,7 @@ void fw_core_handle_response(struct fw_card *card, struct fw_packet *p)
 	u32 *data;
 	size_t data_length;
 	int tcode, tlabel, source, rcode;
+	struct fw_transaction_pool *pool;
 
 	tcode = async_header_get_tcode(p->header);
 	tlabel = async_header_get_tlabel(p->header);
@@ -1176,12 +1941,9 @@ void fw_core_handle_response(struct fw_card *card, struct fw_packet *p)
 		break;
 	}
 
-	// NOTE: This can be without irqsave when we can guarantee that __fw_send_request() for
-	// local destination never runs in any type of IRQ context.
-	scoped_guard(spinlock_irqsave, &card->transactions.lock) {
-		t = find_and_pop_transaction_entry(card,
-				iter->node_id == source && iter->tlabel == tlabel);
-	}
+	pool = transaction_pool(card, source);
+	scoped_guard(transaction_pool, pool)
+		t = pop_transaction_entry(card, pool, find_transaction_entry(pool, source, tlabel));
 
 	trace_async_response_inbound((uintptr_t)t, card->index, p->generation, p->speed, p->ack,
 				     p->timestamp, p->header, data, data_length / 4);
@@ -1465,6 +2227,8 @@ static struct fw_descriptor model_id_descriptor = {
 	.data = model_textual_descriptor,
 };
 
+struct dentry *fw_debugfs_root;
+
 static int __init fw_core_init(void)
 {
 	int ret;
@@ -1474,8 +2238,15 @@ static int __init fw_core_init(void)
 	if (!fw_workqueue)
 		return -ENOMEM;
 
+	ret = create_request_caches();
+	if (ret < 0) {
+		destroy_workqueue(fw_workqueue);
+		return ret;
+	}
+
 	ret = bus_register(&fw_bus_type);
 	if (ret < 0) {
+		destroy_request_caches();
 		destroy_workqueue(fw_workqueue);
 		return ret;
 	}
@@ -1483,6 +2254,7 @@ static int __init fw_core_init(void)
 	fw_cdev_major = register_chrdev(0, "firewire", &fw_device_ops);
 	if (fw_cdev_major < 0) {
 		bus_unregister(&fw_bus_type);
+		destroy_request_caches();
 		destroy_workqueue(fw_workqueue);
 		return fw_cdev_major;
 	}
@@ -1493,13 +2265,19 @@ static int __init fw_core_init(void)
 	fw_core_add_descriptor(&vendor_id_descriptor);
 	fw_core_add_descriptor(&model_id_descriptor);
 
+	fw_debugfs_root = debugfs_create_dir("firewire", NULL);
+
 	return 0;
 }
 
 static void __exit fw_core_cleanup(void)
 {
+	// The address handlers added in fw_core_init() are left.
+	kfree(rcu_dereference_protected(address_handler_table, true));
+	debugfs_remove_recursive(fw_debugfs_root);
 	unregister_chrdev(fw_cdev_major, "firewire");
 	bus_unregister(&fw_bus_type);
+	destroy_request_caches();
 	destroy_workqueue(fw_workqueue);
 	xa_destroy(&fw_device_xa);
 }
@@ -81,10 +81,20 @@ struct fw_card_driver {
 			      const __be32 *config_rom, size_t length);
 
 	void (*send_request)(struct fw_card *card, struct fw_packet *packet);
+	// Submit the request packets linked by their link member at once. The list is consumed.
+	void (*send_requests)(struct fw_card *card, struct list_head *packets);
 	void (*send_response)(struct fw_card *card, struct fw_packet *packet);
 	/* Calling cancel is valid once a packet has been submitted. */
 	int (*cancel_packet)(struct fw_card *card, struct fw_packet *packet);
 
+	// Lend the buffer of payload for the inbound request packet so that the core refers to it
+	// after the packet handler returns, instead of copying it. Returns the address of payload
+	// to refer to, or NULL if not available. The lease should be returned by return_payload()
+	// when the payload is not referred anymore. The return_payload() is callable in any context.
+	void *(*lend_payload)(struct fw_card *card, const struct fw_packet *packet,
+			      unsigned long *lease);
+	void (*return_payload)(struct fw_card *card, unsigned long lease);
+
 	/*
 	 * Allow the specified node ID to do direct DMA out and in of
 	 * host memory.  The card will disable this for all node when
@@ -97,6 +107,9 @@ struct fw_card_driver {
 			       int node_id, int generation);
 
 	u32 (*read_csr)(struct fw_card *card, int csr_offset);
+	// Return the current value of CYCLE_TIME register, estimated without access to hardware as
+	// long as possible. Callable in any context.
+	u32 (*estimate_cycle_time)(struct fw_card *card);
 	void (*write_csr)(struct fw_card *card, int csr_offset, u32 value);
 
 	struct fw_iso_context *
@@ -104,6 +117,15 @@ struct fw_card_driver {
 				size_t header_storage_size);
 	void (*free_iso_context)(struct fw_iso_context *ctx);
 
+	int (*reserve_iso_descriptors)(struct fw_iso_context *ctx, unsigned int packets,
+				       size_t header_length, size_t payload_length);
+
+	int (*create_iso_ring_program)(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+				       unsigned int slots, unsigned int slot_size,
+				       unsigned int irq_interval, int tag);
+	int (*update_iso_ring_slot)(struct fw_iso_context *ctx, unsigned int index,
+				    unsigned int length);
+
 	int (*start_iso)(struct fw_iso_context *ctx,
 			 s32 cycle, u32 sync, u32 tags);
 
@@ -126,6 +148,7 @@ void fw_card_initialize(struct fw_card *card,
 int fw_card_add(struct fw_card *card, u32 max_receive, u32 link_speed, u64 guid,
 		unsigned int supported_isoc_contexts);
 void fw_core_remove_card(struct fw_card *card);
+extern struct dentry *fw_debugfs_root;
 int fw_compute_block_crc(__be32 *block);
 void fw_schedule_bm_work(struct fw_card *card, unsigned long delay);
 
@@ -182,6 +205,38 @@ static inline struct fw_iso_context *fw_iso_mc_context_create(struct fw_card *ca
 				       callback_data);
 }
 
+// The length of the region contiguous in DMA address space from the offset in the buffer, up to
+// the given length. The region can cross the boundary of pages in the same chunk, but not the
+// boundary of chunks even if they are adjacent in DMA address space, since each chunk is mapped
+// separately.
+static inline unsigned long fw_iso_buffer_contiguous_length(const struct fw_iso_buffer *buffer,
+							    unsigned long offset,
+							    unsigned long length)
+{
+	unsigned long page = offset >> PAGE_SHIFT;
+	unsigned long chunk_end = page + 1;
+	unsigned long end = offset + length;
+
+	if (page < buffer->page_count)
+		chunk_end = buffer->chunk_ends[page];
+
+	return min(chunk_end << PAGE_SHIFT, end) - offset;
+}
+
+// Whether the payload in the range of buffer requires cache maintenance by the driver. It is not
+// required when the buffer is in cache-coherent mapping, or when the range has already been
+// synchronized by fw_iso_context_sync_payloads().
+static inline bool fw_iso_context_payload_need_sync(const struct fw_iso_context *ctx,
+						    const struct fw_iso_buffer *buffer,
+						    unsigned long payload, unsigned long length)
+{
+	if (!buffer->need_sync)
+		return false;
+
+	return ctx->synced_payloads.buffer != buffer || payload < ctx->synced_payloads.start ||
+	       payload + length > ctx->synced_payloads.end;
+}
+
 
 /* -topology */
 
@@ -298,6 +353,8 @@ void fw_request_get(struct fw_request *request);
 void fw_request_put(struct fw_request *request);
 
 void fw_cancel_pending_transactions(struct fw_card *card);
+bool fw_has_pending_transactions(struct fw_card *card);
+void fw_transactions_debugfs_init(struct fw_card *card);
 
 // Convert the value of IEEE 1394 CYCLE_TIME register to the format of timeStamp field in
 // descriptors of 1394 OHCI.
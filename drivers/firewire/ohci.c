@@ -8,6 +8,7 @@
 #include <linux/bitops.h>
 #include <linux/bug.h>
 #include <linux/compiler.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/device.h>
 #include <linux/dma-mapping.h>
@@ -17,6 +18,7 @@
 #include <linux/interrupt.h>
 #include <linux/io.h>
 #include <linux/kernel.h>
+#include <linux/ktime.h>
 #include <linux/list.h>
 #include <linux/mm.h>
 #include <linux/module.h>
@@ -24,6 +26,10 @@
 #include <linux/mutex.h>
 #include <linux/pci.h>
 #include <linux/pci_ids.h>
+#include <linux/refcount.h>
+#include <linux/seq_file.h>
+#include <linux/seqlock.h>
+#include <linux/sizes.h>
 #include <linux/slab.h>
 #include <linux/spinlock.h>
 #include <linux/string.h>
@@ -84,25 +90,78 @@ struct descriptor {
 #define CONTEXT_MATCH(regs)	((regs) + 16)
 
 #define AR_BUFFER_SIZE	(32*1024)
-#define AR_BUFFERS_MIN	DIV_ROUND_UP(AR_BUFFER_SIZE, PAGE_SIZE)
-/* we need at least two pages for proper list management */
-#define AR_BUFFERS	MAX(2, AR_BUFFERS_MIN)
+/* we need at least two buffers for proper list management */
+#define AR_BUFFERS_MIN	2
+// The descriptors of AR context are in the quarter of misc buffer.
+#define AR_BUFFERS_MAX	(PAGE_SIZE / 4 / sizeof(struct descriptor))
+// The req_count field of descriptor is 16 bit.
+#define AR_BUFFER_ORDER_MAX	get_order(SZ_32K)
 
 #define MAX_ASYNC_PAYLOAD	4096
 #define MAX_AR_PACKET_SIZE	(16 + MAX_ASYNC_PAYLOAD + 4)
 #define AR_WRAPAROUND_PAGES	DIV_ROUND_UP(MAX_AR_PACKET_SIZE, PAGE_SIZE)
 
+// The number of buckets in histogram of descriptors retired at once. The bucket at index n counts
+// the batches with the size in [2^(n-1), 2^n), except for the last one without upper bound.
+#define CONTEXT_STATS_BATCH_BUCKETS	12
+
+// The statistics of DMA program, exposed in debugfs. They are updated without any lock by the
+// single writer, thus the reader could see inconsistent values between them.
+struct context_stats {
+	// The number of descriptors (or buffers for AR context) appended to the program.
+	u64 queued;
+	// The number of descriptors (or buffers for AR context) retired from the program.
+	u64 retired;
+	// The maximum number of descriptors (or buffers for AR context) queued but not retired yet.
+	u64 high_watermark;
+	u64 batches[CONTEXT_STATS_BATCH_BUCKETS];
+	// The number of times to detect that the context is dead.
+	unsigned long dead;
+	// The time to process the completions, including the callbacks.
+	u64 callback_nsec;
+	u64 callback_max_nsec;
+};
+
+// The buffer of AR context. The context holds one reference and each lease to the core holds one.
+// The buffer lent to the core is detached from the context and replaced with new one when the
+// context is under pressure, then released at the return of the last lease.
+struct ar_buffer {
+	refcount_t refs;
+	struct page *page;
+	dma_addr_t dma_addr;
+};
+
 struct ar_context {
 	struct fw_ohci *ohci;
-	struct page *pages[AR_BUFFERS];
+	// Each buffer for a descriptor consists of pages contiguous in the order.
+	unsigned int buffer_count;
+	unsigned int buffer_order;
+	size_t buffer_size;
+	// The pages of buffers, followed by the wraparound pages.
+	struct page **pages;
 	void *buffer;
-	dma_addr_t dma_addrs[AR_BUFFERS];
+	dma_addr_t *dma_addrs;
 	struct descriptor *descriptors;
 	dma_addr_t descriptors_bus;
 	void *pointer;
+	// The index of buffer which includes the pointer. The buffers between the one next to the
+	// last buffer and this one are already handled, but not linked to the DMA program yet.
+	unsigned int consumer_buffer_index;
 	unsigned int last_buffer_index;
 	u32 regs;
 	struct work_struct work;
+	// The buffer is not recycled for DMA while it is lent to the core.
+	struct ar_buffer **buffers;
+	// The lent buffer which blocks the recycle, or NULL.
+	struct ar_buffer *deferred_buffer;
+	atomic_t lent_buffers;
+	// The number of times to see the whole buffer filled by the controller.
+	unsigned long overruns;
+	// The maximum size of data in the buffer at once.
+	size_t high_watermark;
+	// The payload is not lent while the buffer is reallocated.
+	bool resizing;
+	struct context_stats stats;
 };
 
 struct context;
@@ -157,6 +216,11 @@ struct context {
 	int prev_z;
 
 	descriptor_callback_t callback;
+
+	// The DMA program is preallocated and never grows at runtime.
+	bool fixed_ring;
+
+	struct context_stats stats;
 };
 
 struct at_context {
@@ -182,6 +246,31 @@ struct iso_context {
 			u16 completed;
 		} mc;
 	};
+	// For adaptive interrupt coalescing enabled by fw_iso_context_set_irq_interval().
+	struct {
+		unsigned int interval;
+		unsigned int countdown;
+		unsigned int points;
+		ktime_t irq_stamp;
+	} coalescing;
+	// The range of payload in a page to be synchronized for CPU, coalesced over the packets
+	// completed in a batch.
+	struct {
+		bool needed;
+		dma_addr_t page_bus;
+		unsigned int offset;
+		unsigned int length;
+	} cpu_sync;
+	// For the DMA program of IT context built as a closed loop by
+	// fw_iso_context_create_ring_program().
+	struct {
+		struct descriptor *descriptors;
+		dma_addr_t descriptors_bus;
+		struct fw_iso_buffer *buffer;
+		unsigned int slots;
+		unsigned int slot_size;
+		unsigned int next;
+	} ring;
 };
 
 #define CONFIG_ROM_SIZE		(CSR_CONFIG_ROM_END - CSR_CONFIG_ROM)
@@ -197,6 +286,15 @@ struct fw_ohci {
 	unsigned int pri_req_max;
 	u32 bus_time;
 	bool bus_time_running;
+
+	// The last value read from IsochronousCycleTimer register and the system time just after
+	// reading it, to estimate the current cycle time without MMIO access.
+	struct {
+		seqlock_t lock;
+		u32 value;
+		ktime_t stamp;
+	} cycle_time_snapshot;
+
 	bool is_root;
 	bool csr_state_setclear_abdicate;
 	int n_ir;
@@ -397,10 +495,26 @@ MODULE_PARM_DESC(quirks, "Chip quirks (default = 0"
 	", IR wake unreliable = "	__stringify(QUIRK_IR_WAKE)
 	")");
 
+static unsigned int param_ar_buffer_size = AR_BUFFER_SIZE;
+module_param_named(ar_buffer_size, param_ar_buffer_size, uint, 0644);
+MODULE_PARM_DESC(ar_buffer_size, "Size of buffer for each AR context in bytes, applied to"
+		 " controllers probed later (default = " __stringify(AR_BUFFER_SIZE) ")");
+
+static unsigned int param_ar_buffer_order;
+module_param_named(ar_buffer_order, param_ar_buffer_order, uint, 0644);
+MODULE_PARM_DESC(ar_buffer_order, "Order of pages for each buffer of AR context to use larger"
+		 " buffer with the same number of descriptors, up to 32 KiB per buffer, applied to"
+		 " controllers probed later (default = 0)");
+
 static bool param_remote_dma;
 module_param_named(remote_dma, param_remote_dma, bool, 0444);
 MODULE_PARM_DESC(remote_dma, "Enable unfiltered remote DMA (default = N)");
 
+static unsigned int param_at_ring_depth;
+module_param_named(at_ring_depth, param_at_ring_depth, uint, 0444);
+MODULE_PARM_DESC(at_ring_depth, "Preallocate the DMA program of AT contexts for the number of"
+		 " packets, instead of growing it on demand (default = 0)");
+
 static inline void reg_write(const struct fw_ohci *ohci, int offset, u32 data)
 {
 	writel(data, ohci->registers + offset);
@@ -520,13 +634,35 @@ static int ohci_update_phy_reg(struct fw_card *card, int addr,
 	return update_phy_reg(ohci, addr, clear_bits, set_bits);
 }
 
+static void context_stats_queue(struct context_stats *stats, unsigned int count)
+{
+	u64 depth;
+
+	WRITE_ONCE(stats->queued, stats->queued + count);
+
+	depth = stats->queued - READ_ONCE(stats->retired);
+	if (depth > stats->high_watermark)
+		WRITE_ONCE(stats->high_watermark, depth);
+}
+
+static void context_stats_retire(struct context_stats *stats, unsigned int count, u64 duration)
+{
+	unsigned int index = min(fls(count), CONTEXT_STATS_BATCH_BUCKETS - 1);
+
+	WRITE_ONCE(stats->retired, stats->retired + count);
+	WRITE_ONCE(stats->batches[index], stats->batches[index] + 1);
+	WRITE_ONCE(stats->callback_nsec, stats->callback_nsec + duration);
+	if (duration > stats->callback_max_nsec)
+		WRITE_ONCE(stats->callback_max_nsec, duration);
+}
+
 static void ar_context_link_page(struct ar_context *ctx, unsigned int index)
 {
 	struct descriptor *d;
 
 	d = &ctx->descriptors[index];
 	d->branch_address  &= cpu_to_le32(~0xf);
-	d->res_count       =  cpu_to_le16(PAGE_SIZE);
+	d->res_count       =  cpu_to_le16(ctx->buffer_size);
 	d->transfer_status =  0;
 
 	wmb(); /* finish init of new descriptors before branch_address update */
@@ -534,10 +670,28 @@ static void ar_context_link_page(struct ar_context *ctx, unsigned int index)
 	d->branch_address  |= cpu_to_le32(1);
 
 	ctx->last_buffer_index = index;
+	context_stats_queue(&ctx->stats, 1);
 
 	reg_write(ctx->ohci, CONTROL_SET(ctx->regs), CONTEXT_WAKE);
 }
 
+static void ar_free_pages(struct page *page, unsigned int order)
+{
+	// The pages are split in advance.
+	for (unsigned int i = 0; i < (1 << order); ++i)
+		__free_page(page + i);
+}
+
+static void ar_buffer_put(struct device *dev, struct ar_buffer *buffer, unsigned int order)
+{
+	if (!refcount_dec_and_test(&buffer->refs))
+		return;
+
+	dma_unmap_page(dev, buffer->dma_addr, PAGE_SIZE << order, DMA_FROM_DEVICE);
+	ar_free_pages(buffer->page, order);
+	kfree(buffer);
+}
+
 static void ar_context_release(struct ar_context *ctx)
 {
 	struct device *dev;
@@ -547,18 +701,22 @@ static void ar_context_release(struct ar_context *ctx)
 
 	dev = ctx->ohci->card.device;
 
-	for (int i = 0; i < AR_BUFFERS; ++i) {
-		dma_addr_t dma_addr = ctx->dma_addrs[i];
-		if (dma_addr)
-			dma_unmap_page(dev, dma_addr, PAGE_SIZE, DMA_FROM_DEVICE);
-	}
-	memset(ctx->dma_addrs, 0, sizeof(ctx->dma_addrs));
-
 	vunmap(ctx->buffer);
 	ctx->buffer = NULL;
 
-	release_pages(ctx->pages, AR_BUFFERS);
-	memset(ctx->pages, 0, sizeof(ctx->pages));
+	for (int i = 0; i < ctx->buffer_count; ++i)
+		ar_buffer_put(dev, ctx->buffers[i], ctx->buffer_order);
+	kfree(ctx->buffers);
+	ctx->buffers = NULL;
+
+	kfree(ctx->dma_addrs);
+	ctx->dma_addrs = NULL;
+
+	kfree(ctx->pages);
+	ctx->pages = NULL;
+
+	ctx->buffer_count = 0;
+	ctx->pointer = NULL;
 }
 
 static void ar_context_abort(struct ar_context *ctx, const char *error_msg)
@@ -574,14 +732,14 @@ static void ar_context_abort(struct ar_context *ctx, const char *error_msg)
 	/* FIXME: restart? */
 }
 
-static inline unsigned int ar_next_buffer_index(unsigned int index)
+static inline unsigned int ar_next_buffer_index(const struct ar_context *ctx, unsigned int index)
 {
-	return (index + 1) % AR_BUFFERS;
+	return (index + 1) % ctx->buffer_count;
 }
 
 static inline unsigned int ar_first_buffer_index(struct ar_context *ctx)
 {
-	return ar_next_buffer_index(ctx->last_buffer_index);
+	return ar_next_buffer_index(ctx, ctx->last_buffer_index);
 }
 
 /*
@@ -594,21 +752,21 @@ static unsigned int ar_search_last_active_buffer(struct ar_context *ctx,
 	unsigned int i, next_i, last = ctx->last_buffer_index;
 	__le16 res_count, next_res_count;
 
-	i = ar_first_buffer_index(ctx);
+	i = ctx->consumer_buffer_index;
 	res_count = READ_ONCE(ctx->descriptors[i].res_count);
 
 	/* A buffer that is not yet completely filled must be the last one. */
 	while (i != last && res_count == 0) {
 
 		/* Peek at the next descriptor. */
-		next_i = ar_next_buffer_index(i);
+		next_i = ar_next_buffer_index(ctx, i);
 		rmb(); /* read descriptors in order */
 		next_res_count = READ_ONCE(ctx->descriptors[next_i].res_count);
 		/*
 		 * If the next descriptor is still empty, we must stop at this
 		 * descriptor.
 		 */
-		if (next_res_count == cpu_to_le16(PAGE_SIZE)) {
+		if (next_res_count == cpu_to_le16(ctx->buffer_size)) {
 			/*
 			 * The exception is when the DMA data for one packet is
 			 * split over three buffers; in this case, the middle
@@ -616,11 +774,11 @@ static unsigned int ar_search_last_active_buffer(struct ar_context *ctx,
 			 * controller and look still empty, and we have to peek
 			 * at the third one.
 			 */
-			if (MAX_AR_PACKET_SIZE > PAGE_SIZE && i != last) {
-				next_i = ar_next_buffer_index(next_i);
+			if (MAX_AR_PACKET_SIZE > ctx->buffer_size && i != last) {
+				next_i = ar_next_buffer_index(ctx, next_i);
 				rmb();
 				next_res_count = READ_ONCE(ctx->descriptors[next_i].res_count);
-				if (next_res_count != cpu_to_le16(PAGE_SIZE))
+				if (next_res_count != cpu_to_le16(ctx->buffer_size))
 					goto next_buffer_is_active;
 			}
 
@@ -634,8 +792,8 @@ next_buffer_is_active:
 
 	rmb(); /* read res_count before the DMA data */
 
-	*buffer_offset = PAGE_SIZE - le16_to_cpu(res_count);
-	if (*buffer_offset > PAGE_SIZE) {
+	*buffer_offset = ctx->buffer_size - le16_to_cpu(res_count);
+	if (*buffer_offset > ctx->buffer_size) {
 		*buffer_offset = 0;
 		ar_context_abort(ctx, "corrupted descriptor");
 	}
@@ -649,11 +807,11 @@ static void ar_sync_buffers_for_cpu(struct ar_context *ctx,
 {
 	unsigned int i;
 
-	i = ar_first_buffer_index(ctx);
+	i = ctx->consumer_buffer_index;
 	while (i != end_buffer_index) {
-		dma_sync_single_for_cpu(ctx->ohci->card.device, ctx->dma_addrs[i], PAGE_SIZE,
+		dma_sync_single_for_cpu(ctx->ohci->card.device, ctx->dma_addrs[i], ctx->buffer_size,
 					DMA_FROM_DEVICE);
-		i = ar_next_buffer_index(i);
+		i = ar_next_buffer_index(ctx, i);
 	}
 	if (end_buffer_offset > 0)
 		dma_sync_single_for_cpu(ctx->ohci->card.device, ctx->dma_addrs[i],
@@ -791,43 +949,234 @@ static void *handle_ar_packets(struct ar_context *ctx, void *p, void *end)
 	return p;
 }
 
-static void ar_recycle_buffers(struct ar_context *ctx, unsigned int end_buffer)
+// Allocate the pages for buffers. When the order is not zero, the pages are split so that each of
+// them can be handled in the same way as the order-0 pages.
+static unsigned long ar_context_alloc_pages(unsigned int count, unsigned int order,
+					    struct page **pages)
 {
+	unsigned long nr_populated = 0;
+
+	if (order == 0)
+		return alloc_pages_bulk(GFP_KERNEL | GFP_DMA32, count, pages);
+
+	for (unsigned int i = 0; i < count; ++i) {
+		struct page *page = alloc_pages(GFP_KERNEL | GFP_DMA32 | __GFP_NOWARN, order);
+
+		if (!page)
+			break;
+		split_page(page, order);
+		for (unsigned int j = 0; j < (1 << order); ++j)
+			pages[nr_populated++] = page + j;
+	}
+
+	return nr_populated;
+}
+
+static void ar_context_set_buffer_pages(struct ar_context *ctx, unsigned int index,
+					struct page *page)
+{
+	unsigned int nr_pages = ctx->buffer_count << ctx->buffer_order;
+
+	for (unsigned int i = 0; i < (1 << ctx->buffer_order); ++i)
+		ctx->pages[(index << ctx->buffer_order) + i] = page + i;
+	for (unsigned int i = 0; i < AR_WRAPAROUND_PAGES; ++i)
+		ctx->pages[nr_pages + i] = ctx->pages[i];
+}
+
+// Replace the buffer lent to the core with new one. The pages are remapped so that the data is
+// still contiguous in the kernel virtual address space. It is expensive, thus just used as the
+// last resort.
+static int ar_context_replace_buffer(struct ar_context *ctx, unsigned int index)
+{
+	struct device *dev = ctx->ohci->card.device;
+	unsigned int order = ctx->buffer_order;
+	unsigned int nr_pages = ctx->buffer_count << order;
+	struct page **pages = ctx->pages + (index << order);
+	struct ar_buffer *detached = ctx->buffers[index];
+	struct ar_buffer *buffer __free(kfree) = kmalloc_obj(*buffer, GFP_KERNEL);
+	dma_addr_t dma_addr;
+	void *vaddr;
+
+	if (!buffer)
+		return -ENOMEM;
+
+	// The bulk allocator populates the NULL entries only.
+	memset(pages, 0, sizeof(*pages) << order);
+	if (ar_context_alloc_pages(1, order, pages) != 1 << order) {
+		ar_context_set_buffer_pages(ctx, index, detached->page);
+		return -ENOMEM;
+	}
+	ar_context_set_buffer_pages(ctx, index, pages[0]);
+
+	dma_addr = dma_map_page(dev, pages[0], 0, ctx->buffer_size, DMA_FROM_DEVICE);
+	if (dma_mapping_error(dev, dma_addr))
+		goto error_pages;
+
+	vaddr = vmap(ctx->pages, nr_pages + AR_WRAPAROUND_PAGES, VM_MAP, PAGE_KERNEL);
+	if (!vaddr) {
+		dma_unmap_page(dev, dma_addr, ctx->buffer_size, DMA_FROM_DEVICE);
+		goto error_pages;
+	}
+
+	ctx->pointer = vaddr + (ctx->pointer - ctx->buffer);
+	vunmap(ctx->buffer);
+	ctx->buffer = vaddr;
+
+	refcount_set(&buffer->refs, 1);
+	buffer->page = pages[0];
+	buffer->dma_addr = dma_addr;
+	ctx->buffers[index] = no_free_ptr(buffer);
+	ctx->dma_addrs[index] = dma_addr;
+	ctx->descriptors[index].data_address = cpu_to_le32(dma_addr);
+
+	// The detached buffer is released at the return of the last lease.
+	ar_buffer_put(dev, detached, order);
+
+	return 0;
+error_pages:
+	ar_free_pages(pages[0], order);
+	ar_context_set_buffer_pages(ctx, index, detached->page);
+	return -ENOMEM;
+}
+
+static unsigned int ar_recycle_buffers(struct ar_context *ctx)
+{
+	unsigned int recycled = 0;
 	unsigned int i;
 
 	i = ar_first_buffer_index(ctx);
-	while (i != end_buffer) {
-		dma_sync_single_for_device(ctx->ohci->card.device, ctx->dma_addrs[i], PAGE_SIZE,
-					   DMA_FROM_DEVICE);
+	while (i != ctx->consumer_buffer_index) {
+		struct ar_buffer *buffer = ctx->buffers[i];
+
+		// The buffers should be linked in order. The buffer lent to the core and the
+		// subsequent buffers are recycled later when the buffer is returned. When the
+		// buffers waiting for the return reach the half, the lent buffer is replaced so
+		// that the controller can continue receiving packets.
+		if (refcount_read(&buffer->refs) > 1) {
+			unsigned int pending = (ctx->consumer_buffer_index + ctx->buffer_count - i) %
+					       ctx->buffer_count;
+
+			// The deferred buffer is published before checking the reference count
+			// again, paired with ohci_return_payload() which releases the reference
+			// before checking it.
+			WRITE_ONCE(ctx->deferred_buffer, buffer);
+			smp_mb();
+			if (refcount_read(&buffer->refs) > 1 &&
+			    (pending < ctx->buffer_count / 2 || ar_context_replace_buffer(ctx, i) < 0))
+				return recycled;
+		}
+		dma_sync_single_for_device(ctx->ohci->card.device, ctx->dma_addrs[i],
+					   ctx->buffer_size, DMA_FROM_DEVICE);
 		ar_context_link_page(ctx, i);
-		i = ar_next_buffer_index(i);
+		i = ar_next_buffer_index(ctx, i);
+		++recycled;
+	}
+	WRITE_ONCE(ctx->deferred_buffer, NULL);
+
+	return recycled;
+}
+
+static void *ohci_lend_payload(struct fw_card *card, const struct fw_packet *packet,
+			       unsigned long *lease)
+{
+	struct ar_context *ctx = &fw_ohci(card)->ar_request_ctx;
+	uintptr_t offset = (uintptr_t)packet->payload - (uintptr_t)ctx->buffer;
+	size_t total = ctx->buffer_count * ctx->buffer_size;
+	struct ar_buffer *buffer;
+	unsigned int index;
+
+	// The payload of the packet for the local node is not in the AR buffer.
+	if (!ctx->buffer || offset >= total + AR_WRAPAROUND_PAGES * PAGE_SIZE)
+		return NULL;
+
+	// While the recycle of buffers is blocked by the lent buffer, the payload is copied so that
+	// the new lease does not block it further.
+	if (READ_ONCE(ctx->deferred_buffer) || ctx->resizing)
+		return NULL;
+
+	// The data in wraparound pages is the same as the one in the buffer at the beginning. The
+	// payload across buffers is not lent since it is not contiguous out of the AR context.
+	index = (offset / ctx->buffer_size) % ctx->buffer_count;
+	offset %= ctx->buffer_size;
+	if (offset + packet->payload_length > ctx->buffer_size)
+		return NULL;
+
+	// The leases at the same time are limited so that the memory for the detached buffers is
+	// bounded. The payload is copied when the limit is reached.
+	if (atomic_inc_return(&ctx->lent_buffers) > ctx->buffer_count / 2) {
+		atomic_dec(&ctx->lent_buffers);
+		return NULL;
 	}
+
+	buffer = ctx->buffers[index];
+	refcount_inc(&buffer->refs);
+	*lease = (unsigned long)buffer;
+
+	// The buffer can be detached from the AR context and unmapped from its address space,
+	// while the pages allocated with GFP_DMA32 are always in the linear mapping.
+	return page_address(buffer->page) + offset;
+}
+
+static void ohci_return_payload(struct fw_card *card, unsigned long lease)
+{
+	struct ar_context *ctx = &fw_ohci(card)->ar_request_ctx;
+	struct ar_buffer *buffer = (struct ar_buffer *)lease;
+
+	// The buffer is released before the count of leases decreases, so that the context is not
+	// reallocated in the meantime.
+	ar_buffer_put(card->device, buffer, ctx->buffer_order);
+	atomic_dec(&ctx->lent_buffers);
+
+	// Recycle the buffers deferred by the returned one at the last work. The pointer is just
+	// compared.
+	smp_mb();
+	if (READ_ONCE(ctx->deferred_buffer) == buffer)
+		queue_work(card->async_wq, &ctx->work);
 }
 
 static void ohci_ar_context_work(struct work_struct *work)
 {
 	struct ar_context *ctx = from_work(ctx, work, work);
 	unsigned int end_buffer_index, end_buffer_offset;
+	unsigned int recycled;
 	void *p, *end;
+	u64 start;
 
 	p = ctx->pointer;
 	if (!p)
 		return;
 
+	start = ktime_get_ns();
+
 	end_buffer_index = ar_search_last_active_buffer(ctx, &end_buffer_offset);
 	ar_sync_buffers_for_cpu(ctx, end_buffer_index, end_buffer_offset);
-	end = ctx->buffer + end_buffer_index * PAGE_SIZE + end_buffer_offset;
+	end = ctx->buffer + end_buffer_index * ctx->buffer_size + end_buffer_offset;
 
-	if (end_buffer_index < ar_first_buffer_index(ctx)) {
+	if (p != end) {
+		unsigned int first = ctx->consumer_buffer_index;
+		size_t filled = ((end_buffer_index + ctx->buffer_count - first) % ctx->buffer_count) *
+				ctx->buffer_size + end_buffer_offset;
+
+		if (filled > ctx->high_watermark)
+			WRITE_ONCE(ctx->high_watermark, filled);
+
+		// The controller has no space to store packets anymore.
+		if (end_buffer_index == ctx->last_buffer_index &&
+		    end_buffer_offset == ctx->buffer_size)
+			WRITE_ONCE(ctx->overruns, ctx->overruns + 1);
+	}
+
+	if (end_buffer_index < ctx->consumer_buffer_index) {
 		// The filled part of the overall buffer wraps around; handle all packets up to the
 		// buffer end here.  If the last packet wraps around, its tail will be visible after
 		// the buffer end because the buffer start pages are mapped there again.
-		void *buffer_end = ctx->buffer + AR_BUFFERS * PAGE_SIZE;
+		size_t total = ctx->buffer_count * ctx->buffer_size;
+		void *buffer_end = ctx->buffer + total;
 		p = handle_ar_packets(ctx, p, buffer_end);
 		if (p < buffer_end)
 			goto error;
 		// adjust p to point back into the actual buffer
-		p -= AR_BUFFERS * PAGE_SIZE;
+		p -= total;
 	}
 
 	p = handle_ar_packets(ctx, p, end);
@@ -838,33 +1187,62 @@ static void ohci_ar_context_work(struct work_struct *work)
 	}
 
 	ctx->pointer = p;
-	ar_recycle_buffers(ctx, end_buffer_index);
+	ctx->consumer_buffer_index = end_buffer_index;
+	recycled = ar_recycle_buffers(ctx);
+	context_stats_retire(&ctx->stats, recycled, ktime_get_ns() - start);
 
 	return;
 error:
 	ctx->pointer = NULL;
 }
 
-static int ar_context_init(struct ar_context *ctx, struct fw_ohci *ohci,
-			   unsigned int descriptors_offset, u32 regs)
+static int ar_context_alloc_buffer(struct ar_context *ctx, unsigned int size)
 {
-	struct device *dev = ohci->card.device;
-	unsigned int i;
-	struct page *pages[AR_BUFFERS + AR_WRAPAROUND_PAGES] = { NULL };
-	dma_addr_t dma_addrs[AR_BUFFERS];
+	struct device *dev = ctx->ohci->card.device;
+	unsigned int i, count, order, nr_pages;
+	struct page **pages __free(kfree) = NULL;
+	dma_addr_t *dma_addrs __free(kfree) = NULL;
+	struct ar_buffer **buffers __free(kfree) = NULL;
+	unsigned long nr_populated;
+	size_t buffer_size;
 	void *vaddr;
 	struct descriptor *d;
 
-	ctx->regs        = regs;
-	ctx->ohci        = ohci;
-	INIT_WORK(&ctx->work, ohci_ar_context_work);
+	ctx->overruns = 0;
+	ctx->high_watermark = 0;
+
+	order = min_t(unsigned int, READ_ONCE(param_ar_buffer_order), AR_BUFFER_ORDER_MAX);
+	count = clamp_t(unsigned int,
+			DIV_ROUND_UP(size, PAGE_SIZE << order),
+			AR_BUFFERS_MIN, AR_BUFFERS_MAX);
+	nr_pages = count << order;
+
+	pages = kcalloc(nr_pages + AR_WRAPAROUND_PAGES, sizeof(*pages), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
 
 	// Retrieve noncontiguous pages. The descriptors for 1394 OHCI AR DMA contexts have a set
 	// of address and length per each. The reason to use pages is to construct contiguous
 	// address range in kernel virtual address space.
-	unsigned long nr_populated = alloc_pages_bulk(GFP_KERNEL | GFP_DMA32, AR_BUFFERS, pages);
+	nr_populated = ar_context_alloc_pages(count, order, pages);
+	if (nr_populated != nr_pages && order > 0) {
+		// Fallback to order-0 pages with the same size of buffer as possible.
+		release_pages(pages, nr_populated);
+		memset(pages, 0, (nr_pages + AR_WRAPAROUND_PAGES) * sizeof(*pages));
+		count = min_t(unsigned int, nr_pages, AR_BUFFERS_MAX);
+		order = 0;
+		nr_pages = count;
+		nr_populated = ar_context_alloc_pages(count, order, pages);
+	}
+	if (nr_populated != nr_pages) {
+		release_pages(pages, nr_populated);
+		return -ENOMEM;
+	}
+	buffer_size = PAGE_SIZE << order;
 
-	if (nr_populated != AR_BUFFERS) {
+	dma_addrs = kcalloc(count, sizeof(*dma_addrs), GFP_KERNEL);
+	buffers = kcalloc(count, sizeof(*buffers), GFP_KERNEL);
+	if (!dma_addrs || !buffers) {
 		release_pages(pages, nr_populated);
 		return -ENOMEM;
 	}
@@ -873,63 +1251,178 @@ static int ar_context_init(struct ar_context *ctx, struct fw_ohci *ohci,
 	// across the pages can be referred as being contiguous, especially across the last
 	// and first pages.
 	for (i = 0; i < AR_WRAPAROUND_PAGES; i++)
-		pages[AR_BUFFERS + i] = pages[i];
-	vaddr = vmap(pages, ARRAY_SIZE(pages), VM_MAP, PAGE_KERNEL);
+		pages[nr_pages + i] = pages[i];
+	vaddr = vmap(pages, nr_pages + AR_WRAPAROUND_PAGES, VM_MAP, PAGE_KERNEL);
 	if (!vaddr) {
 		release_pages(pages, nr_populated);
 		return -ENOMEM;
 	}
 
-	// Retrieve DMA mapping addresses for the pages. They are not contiguous. Maintain the cache
-	// coherency for the pages by hand.
-	for (i = 0; i < AR_BUFFERS; i++) {
-		// The dma_map_phys() with a physical address per page is available here, instead.
-		dma_addr_t dma_addr = dma_map_page(dev, pages[i], 0, PAGE_SIZE, DMA_FROM_DEVICE);
-		if (dma_mapping_error(dev, dma_addr))
+	// Retrieve DMA mapping addresses for the buffers. They are not contiguous. Maintain the
+	// cache coherency for the buffers by hand.
+	for (i = 0; i < count; i++) {
+		struct ar_buffer *buffer = kmalloc_obj(*buffer, GFP_KERNEL);
+		dma_addr_t dma_addr;
+
+		if (!buffer)
 			break;
+		// The dma_map_phys() with a physical address per buffer is available here, instead.
+		dma_addr = dma_map_page(dev, pages[i << order], 0, buffer_size, DMA_FROM_DEVICE);
+		if (dma_mapping_error(dev, dma_addr)) {
+			kfree(buffer);
+			break;
+		}
+		refcount_set(&buffer->refs, 1);
+		buffer->page = pages[i << order];
+		buffer->dma_addr = dma_addr;
+		buffers[i] = buffer;
 		dma_addrs[i] = dma_addr;
-		dma_sync_single_for_device(dev, dma_addr, PAGE_SIZE, DMA_FROM_DEVICE);
+		dma_sync_single_for_device(dev, dma_addr, buffer_size, DMA_FROM_DEVICE);
 	}
-	if (i < AR_BUFFERS) {
-		while (i-- > 0)
-			dma_unmap_page(dev, dma_addrs[i], PAGE_SIZE, DMA_FROM_DEVICE);
+	if (i < count) {
+		while (i-- > 0) {
+			dma_unmap_page(dev, dma_addrs[i], buffer_size, DMA_FROM_DEVICE);
+			kfree(buffers[i]);
+		}
 		vunmap(vaddr);
 		release_pages(pages, nr_populated);
 		return -ENOMEM;
 	}
 
-	memcpy(ctx->dma_addrs, dma_addrs, sizeof(ctx->dma_addrs));
+	ctx->buffer_count = count;
+	ctx->buffer_order = order;
+	ctx->buffer_size = buffer_size;
+	ctx->dma_addrs = no_free_ptr(dma_addrs);
+	ctx->buffers = no_free_ptr(buffers);
 	ctx->buffer = vaddr;
-	memcpy(ctx->pages, pages, sizeof(ctx->pages));
-
-	ctx->descriptors     = ohci->misc_buffer     + descriptors_offset;
-	ctx->descriptors_bus = ohci->misc_buffer_bus + descriptors_offset;
+	ctx->pages = no_free_ptr(pages);
 
-	for (i = 0; i < AR_BUFFERS; i++) {
+	for (i = 0; i < ctx->buffer_count; i++) {
 		d = &ctx->descriptors[i];
-		d->req_count      = cpu_to_le16(PAGE_SIZE);
+		d->req_count      = cpu_to_le16(ctx->buffer_size);
 		d->control        = cpu_to_le16(DESCRIPTOR_INPUT_MORE |
 						DESCRIPTOR_STATUS |
 						DESCRIPTOR_BRANCH_ALWAYS);
 		d->data_address   = cpu_to_le32(ctx->dma_addrs[i]);
 		d->branch_address = cpu_to_le32(ctx->descriptors_bus +
-			ar_next_buffer_index(i) * sizeof(struct descriptor));
+			ar_next_buffer_index(ctx, i) * sizeof(struct descriptor));
 	}
 
 	return 0;
 }
 
-static void ar_context_run(struct ar_context *ctx)
+static int ar_context_init(struct ar_context *ctx, struct fw_ohci *ohci,
+			   unsigned int descriptors_offset, u32 regs, unsigned int size)
+{
+	ctx->regs        = regs;
+	ctx->ohci        = ohci;
+	INIT_WORK(&ctx->work, ohci_ar_context_work);
+	atomic_set(&ctx->lent_buffers, 0);
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
+
+	ctx->descriptors     = ohci->misc_buffer     + descriptors_offset;
+	ctx->descriptors_bus = ohci->misc_buffer_bus + descriptors_offset;
+
+	return ar_context_alloc_buffer(ctx, size);
+}
+
+static void ar_context_stop(struct ar_context *ctx)
+{
+	struct fw_ohci *ohci = ctx->ohci;
+	u32 reg;
+
+	reg_write(ohci, CONTROL_CLEAR(ctx->regs), CONTEXT_RUN);
+	flush_writes(ohci);
+
+	for (int i = 0; i < 1000; i++) {
+		reg = reg_read(ohci, CONTROL_SET(ctx->regs));
+		if ((reg & CONTEXT_ACTIVE) == 0)
+			return;
+
+		if (i)
+			udelay(10);
+	}
+	ohci_err(ohci, "AR DMA context still active (0x%08x)\n", reg);
+}
+
+static int ar_context_run(struct ar_context *ctx);
+
+// Reallocate the buffer in the given size. The context stops in the meantime, and the packets
+// received before stopping are handled. It is not available while any buffer is lent to the core.
+static int ar_context_resize(struct ar_context *ctx, unsigned int size)
+{
+	struct fw_ohci *ohci = ctx->ohci;
+	unsigned int current_size = ctx->buffer_count * ctx->buffer_size;
+	bool running;
+	int err;
+
+	// The payload is lent only in the work. Once it is disabled, no lease is added and the
+	// return of lease does not queue it anymore.
+	disable_work_sync(&ctx->work);
+
+	if (atomic_read(&ctx->lent_buffers) > 0) {
+		err = -EBUSY;
+		goto end;
+	}
+
+	// The context not running yet starts with the new buffer at ohci_enable().
+	running = !!(reg_read(ohci, CONTROL_SET(ctx->regs)) & CONTEXT_RUN);
+	if (running)
+		ar_context_stop(ctx);
+
+	ctx->resizing = true;
+	ohci_ar_context_work(&ctx->work);
+	ctx->resizing = false;
+
+	ar_context_release(ctx);
+
+	err = ar_context_alloc_buffer(ctx, size);
+	if (err < 0) {
+		ohci_notice(ohci, "failed to reallocate AR buffer in %u bytes\n", size);
+		if (ar_context_alloc_buffer(ctx, current_size) < 0) {
+			ohci_err(ohci, "failed to reallocate AR buffer; DMA stopped\n");
+			goto end;
+		}
+	}
+
+	// Never fails since no buffer is lent.
+	if (running)
+		ar_context_run(ctx);
+end:
+	enable_work(&ctx->work);
+
+	return err;
+}
+
+static int ar_context_run(struct ar_context *ctx)
 {
 	unsigned int i;
+	int err;
 
-	for (i = 0; i < AR_BUFFERS; i++)
+	// The reallocation of buffer failed at runtime.
+	if (!ctx->buffer)
+		return -ENOMEM;
+
+	// The buffer still lent to the core should not be overwritten by the controller.
+	for (i = 0; i < ctx->buffer_count; i++) {
+		if (refcount_read(&ctx->buffers[i]->refs) > 1) {
+			err = ar_context_replace_buffer(ctx, i);
+			if (err < 0)
+				return err;
+		}
+	}
+
+	for (i = 0; i < ctx->buffer_count; i++)
 		ar_context_link_page(ctx, i);
 
 	ctx->pointer = ctx->buffer;
+	ctx->consumer_buffer_index = 0;
+	WRITE_ONCE(ctx->deferred_buffer, NULL);
 
 	reg_write(ctx->ohci, COMMAND_PTR(ctx->regs), ctx->descriptors_bus | 1);
 	reg_write(ctx->ohci, CONTROL_SET(ctx->regs), CONTEXT_RUN);
+
+	return 0;
 }
 
 static struct descriptor *find_branch_descriptor(struct descriptor *d, int z)
@@ -945,12 +1438,15 @@ static struct descriptor *find_branch_descriptor(struct descriptor *d, int z)
 		return d + z - 1;
 }
 
-static void context_retire_descriptors(struct context *ctx)
+static unsigned int context_retire_descriptors(struct context *ctx)
 {
 	struct descriptor *d, *last;
 	u32 address;
 	int z;
 	struct descriptor_buffer *desc;
+	unsigned int retired = 0;
+	unsigned int descriptors = 0;
+	u64 start = ktime_get_ns();
 
 	desc = list_entry(ctx->buffer_list.next,
 			struct descriptor_buffer, list);
@@ -982,7 +1478,13 @@ static void context_retire_descriptors(struct context *ctx)
 			list_move_tail(&old_desc->list, &ctx->buffer_list);
 		}
 		ctx->last = last;
+		++retired;
+		descriptors += z;
 	}
+
+	context_stats_retire(&ctx->stats, descriptors, ktime_get_ns() - start);
+
+	return retired;
 }
 
 static void ohci_at_context_work(struct work_struct *work)
@@ -992,12 +1494,147 @@ static void ohci_at_context_work(struct work_struct *work)
 	context_retire_descriptors(&ctx->context);
 }
 
+// The duration of isochronous cycle in nanoseconds.
+#define ISOC_CYCLE_NSEC		125000
+
+// Decide the next interval of hardware interrupts by the latency of the consumer to process the
+// completions since the last hardware interrupt, and the backlog of interrupt points retired at
+// once. The interval grows twice while the consumer is late, and shrinks by half while it keeps
+// up with the completions.
+static void update_irq_coalescing(struct iso_context *ctx)
+{
+	unsigned int interval = READ_ONCE(ctx->coalescing.interval);
+	unsigned int points = ctx->coalescing.points;
+	s64 latency, budget;
+
+	if (interval == 0 || points == 0)
+		return;
+	ctx->coalescing.points = 0;
+
+	latency = ktime_to_ns(ktime_sub(ktime_get(), READ_ONCE(ctx->coalescing.irq_stamp)));
+	budget = (s64)interval * ISOC_CYCLE_NSEC;
+
+	if (points > 1 || latency > budget / 2)
+		interval = min(interval * 2, ctx->base.irq_interval.max);
+	else if (latency < budget / 8)
+		interval = max(interval / 2, ctx->base.irq_interval.min);
+
+	WRITE_ONCE(ctx->coalescing.interval, interval);
+}
+
+// The interrupt points retired out of the hardware interrupt do not tell the latency of the
+// consumer, thus they are not used for the next decision.
+static void discard_irq_coalescing_sample(struct iso_context *ctx)
+{
+	ctx->coalescing.points = 0;
+	WRITE_ONCE(ctx->coalescing.irq_stamp, ktime_get());
+}
+
+static void reset_irq_coalescing(struct iso_context *ctx)
+{
+	if (ctx->base.irq_interval.max == 0)
+		return;
+
+	WRITE_ONCE(ctx->coalescing.interval, ctx->base.irq_interval.min);
+	ctx->coalescing.countdown = ctx->base.irq_interval.min;
+	discard_irq_coalescing_sample(ctx);
+}
+
+static void flush_payload_sync_for_cpu(struct iso_context *ctx)
+{
+	enum dma_data_direction direction;
+
+	if (ctx->cpu_sync.length == 0)
+		return;
+
+	if (ctx->base.type == FW_ISO_CONTEXT_TRANSMIT)
+		direction = DMA_TO_DEVICE;
+	else
+		direction = DMA_FROM_DEVICE;
+
+	dma_sync_single_range_for_cpu(ctx->context.ohci->card.device, ctx->cpu_sync.page_bus,
+				      ctx->cpu_sync.offset, ctx->cpu_sync.length, direction);
+	ctx->cpu_sync.length = 0;
+}
+
+// The payloads of packets completed in order are usually contiguous in the same page. Instead of
+// the synchronization per packet, coalesce them and synchronize once per page.
+static void queue_payload_sync_for_cpu(struct iso_context *ctx, u32 buffer_dma,
+				       unsigned int length)
+{
+	dma_addr_t page_bus = buffer_dma & PAGE_MASK;
+	unsigned int offset = buffer_dma & ~PAGE_MASK;
+
+	if (!ctx->cpu_sync.needed || length == 0)
+		return;
+
+	if (ctx->cpu_sync.length > 0 && ctx->cpu_sync.page_bus == page_bus &&
+	    ctx->cpu_sync.offset + ctx->cpu_sync.length == offset) {
+		ctx->cpu_sync.length += length;
+		return;
+	}
+
+	flush_payload_sync_for_cpu(ctx);
+
+	ctx->cpu_sync.page_bus = page_bus;
+	ctx->cpu_sync.offset = offset;
+	ctx->cpu_sync.length = length;
+}
+
+static unsigned int it_ring_retire_slots(struct iso_context *ctx);
+
+static unsigned int iso_context_retire(struct iso_context *ctx)
+{
+	unsigned int retired;
+
+	if (ctx->ring.descriptors)
+		retired = it_ring_retire_slots(ctx);
+	else
+		retired = context_retire_descriptors(&ctx->context);
+
+	flush_payload_sync_for_cpu(ctx);
+
+	return retired;
+}
+
 static void ohci_isoc_context_work(struct work_struct *work)
 {
 	struct fw_iso_context *base = from_work(base, work, work);
 	struct iso_context *isoc_ctx = container_of(base, struct iso_context, base);
 
-	context_retire_descriptors(&isoc_ctx->context);
+	iso_context_retire(isoc_ctx);
+	update_irq_coalescing(isoc_ctx);
+}
+
+/*
+ * 16MB of descriptors should be far more than enough for any DMA
+ * program.  This will catch run-away userspace or DoS attacks.
+ */
+#define MAX_DESCRIPTOR_ALLOCATION	(16 * 1024 * 1024)
+
+/*
+ * Some controllers, like JMicron ones, always issue 0x20-byte DMA reads
+ * for descriptors, even 0x10-byte ones. This can cause page faults when
+ * an IOMMU is in use and the oversized read crosses a page boundary.
+ * Work around this by always leaving at least 0x10 bytes of padding.
+ */
+#define DESCRIPTOR_BUFFER_SIZE \
+	(PAGE_SIZE - offsetof(struct descriptor_buffer, buffer) - 0x10)
+
+static struct descriptor_buffer *alloc_descriptor_buffer(struct context *ctx, gfp_t gfp)
+{
+	struct descriptor_buffer *desc;
+	dma_addr_t bus_addr;
+
+	desc = dmam_alloc_coherent(ctx->ohci->card.device, PAGE_SIZE, &bus_addr, gfp);
+	if (!desc)
+		return NULL;
+
+	desc->buffer_size = DESCRIPTOR_BUFFER_SIZE;
+	desc->buffer_bus = bus_addr + offsetof(struct descriptor_buffer, buffer);
+	desc->used = 0;
+
+	return desc;
 }
 
 /*
@@ -1007,43 +1644,70 @@ static void ohci_isoc_context_work(struct work_struct *work)
 static int context_add_buffer(struct context *ctx)
 {
 	struct descriptor_buffer *desc;
-	dma_addr_t bus_addr;
-	int offset;
 
-	/*
-	 * 16MB of descriptors should be far more than enough for any DMA
-	 * program.  This will catch run-away userspace or DoS attacks.
-	 */
-	if (ctx->total_allocation >= 16*1024*1024)
+	if (ctx->total_allocation >= MAX_DESCRIPTOR_ALLOCATION)
 		return -ENOMEM;
 
-	desc = dmam_alloc_coherent(ctx->ohci->card.device, PAGE_SIZE, &bus_addr, GFP_ATOMIC);
+	desc = alloc_descriptor_buffer(ctx, GFP_ATOMIC);
 	if (!desc)
 		return -ENOMEM;
 
-	offset = (void *)&desc->buffer - (void *)desc;
-	/*
-	 * Some controllers, like JMicron ones, always issue 0x20-byte DMA reads
-	 * for descriptors, even 0x10-byte ones. This can cause page faults when
-	 * an IOMMU is in use and the oversized read crosses a page boundary.
-	 * Work around this by always leaving at least 0x10 bytes of padding.
-	 */
-	desc->buffer_size = PAGE_SIZE - offset - 0x10;
-	desc->buffer_bus = bus_addr + offset;
-	desc->used = 0;
-
 	list_add_tail(&desc->list, &ctx->buffer_list);
 	ctx->total_allocation += PAGE_SIZE;
 
 	return 0;
 }
 
+// Preallocate the buffers enough to store the given number of descriptors in flight, then stop
+// growing the DMA program at runtime. Must be called in process context before queueing.
+static int context_reserve_buffers(struct context *ctx, unsigned long descriptors)
+{
+	unsigned int count, allocated, added = 0;
+	LIST_HEAD(buffers);
+
+	if (descriptors > MAX_DESCRIPTOR_ALLOCATION / sizeof(struct descriptor))
+		return -EINVAL;
+
+	// One more buffer is required since the buffer is not recycled till all of descriptors in it
+	// are retired.
+	count = DIV_ROUND_UP(descriptors * sizeof(struct descriptor), DESCRIPTOR_BUFFER_SIZE) + 1;
+	if (count > MAX_DESCRIPTOR_ALLOCATION / PAGE_SIZE)
+		return -EINVAL;
+
+	allocated = READ_ONCE(ctx->total_allocation) / PAGE_SIZE;
+	for (; allocated < count; ++allocated) {
+		struct descriptor_buffer *desc = alloc_descriptor_buffer(ctx, GFP_KERNEL);
+
+		if (!desc) {
+			struct descriptor_buffer *tmp;
+
+			list_for_each_entry_safe(desc, tmp, &buffers, list) {
+				dmam_free_coherent(ctx->ohci->card.device, PAGE_SIZE, desc,
+						   desc->buffer_bus -
+						   offsetof(struct descriptor_buffer, buffer));
+			}
+			return -ENOMEM;
+		}
+		list_add_tail(&desc->list, &buffers);
+		++added;
+	}
+
+	guard(spinlock_irq)(&ctx->ohci->lock);
+
+	list_splice_tail(&buffers, &ctx->buffer_list);
+	ctx->total_allocation += added * PAGE_SIZE;
+	ctx->fixed_ring = true;
+
+	return 0;
+}
+
 static int context_init(struct context *ctx, struct fw_ohci *ohci,
 			u32 regs, descriptor_callback_t callback)
 {
 	ctx->ohci = ohci;
 	ctx->regs = regs;
 	ctx->total_allocation = 0;
+	memset(&ctx->stats, 0, sizeof(ctx->stats));
 
 	INIT_LIST_HEAD(&ctx->buffer_list);
 	if (context_add_buffer(ctx) < 0)
@@ -1089,17 +1753,21 @@ static struct descriptor *context_get_descriptors(struct context *ctx,
 	struct descriptor_buffer *desc = ctx->buffer_tail;
 
 	if (z * sizeof(*d) > desc->buffer_size)
-		return NULL;
+		return ERR_PTR(-ENOMEM);
 
 	if (z * sizeof(*d) > desc->buffer_size - desc->used) {
 		/* No room for the descriptor in this buffer, so advance to the
 		 * next one. */
 
 		if (desc->list.next == &ctx->buffer_list) {
+			// The preallocated ring is full. Fail fast instead of growing it.
+			if (ctx->fixed_ring)
+				return ERR_PTR(-ENOBUFS);
+
 			/* If there is no free buffer next in the list,
 			 * allocate one. */
 			if (context_add_buffer(ctx) < 0)
-				return NULL;
+				return ERR_PTR(-ENOMEM);
 		}
 		desc = list_entry(desc->list.next,
 				struct descriptor_buffer, list);
@@ -1159,6 +1827,8 @@ static void context_append(struct context *ctx,
 
 	ctx->prev = d;
 	ctx->prev_z = z;
+
+	context_stats_queue(&ctx->stats, z);
 }
 
 static void context_stop(struct context *ctx)
@@ -1187,7 +1857,8 @@ struct driver_data {
 };
 
 /*
- * This function appends a packet to the DMA queue for transmission.
+ * This function appends a packet to the DMA queue for transmission. The
+ * caller is responsible to wake the context by at_context_wake() afterwards.
  * Must always be called with the ochi->lock held to ensure proper
  * generation handling and locking around packet queue manipulation.
  */
@@ -1202,7 +1873,9 @@ static int at_context_queue_packet(struct at_context *ctx, struct fw_packet *pac
 	int z, tcode;
 
 	d = context_get_descriptors(context, 4, &d_bus);
-	if (d == NULL) {
+	if (IS_ERR(d)) {
+		if (PTR_ERR(d) == -ENOBUFS)
+			dev_err_ratelimited(ohci->card.device, "AT DMA program is full\n");
 		packet->ack = RCODE_SEND_ERROR;
 		return -1;
 	}
@@ -1322,12 +1995,20 @@ static int at_context_queue_packet(struct at_context *ctx, struct fw_packet *pac
 
 	context_append(context, d, z, 4 - z);
 
+	return 0;
+}
+
+// Notify the controller of descriptors appended by at_context_queue_packet(). A single wake
+// covers any number of packets linked into the program since the last one. Must be called with
+// the ohci->lock held.
+static void at_context_wake(struct at_context *ctx)
+{
+	struct context *context = &ctx->context;
+
 	if (context->running)
-		reg_write(ohci, CONTROL_SET(context->regs), CONTEXT_WAKE);
+		reg_write(context->ohci, CONTROL_SET(context->regs), CONTEXT_WAKE);
 	else
 		context_run(context, 0);
-
-	return 0;
 }
 
 static void at_context_flush(struct at_context *ctx)
@@ -1454,7 +2135,7 @@ static int handle_at_packet(struct context *context,
 	return 1;
 }
 
-static u32 get_cycle_time(struct fw_ohci *ohci);
+static u32 estimate_cycle_time(struct fw_ohci *ohci);
 
 static void handle_local_rom(struct fw_ohci *ohci,
 			     struct fw_packet *packet, u32 csr)
@@ -1481,7 +2162,7 @@ static void handle_local_rom(struct fw_ohci *ohci,
 	}
 
 	// Timestamping on behalf of the hardware.
-	response.timestamp = cycle_time_to_ohci_tstamp(get_cycle_time(ohci));
+	response.timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
 	fw_core_handle_response(&ohci->card, &response);
 }
 
@@ -1531,7 +2212,7 @@ static void handle_local_lock(struct fw_ohci *ohci,
 
  out:
 	// Timestamping on behalf of the hardware.
-	response.timestamp = cycle_time_to_ohci_tstamp(get_cycle_time(ohci));
+	response.timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
 	fw_core_handle_response(&ohci->card, &response);
 }
 
@@ -1570,40 +2251,99 @@ static void handle_local_request(struct at_context *ctx, struct fw_packet *packe
 		packet->ack = ACK_COMPLETE;
 		packet->callback(packet, &ohci->card, packet->ack);
 	}
-}
+}
+
+static void at_context_transmit(struct at_context *ctx, struct fw_packet *packet)
+{
+	struct fw_ohci *ohci = ctx->context.ohci;
+	unsigned long flags;
+	int ret;
+
+	spin_lock_irqsave(&ohci->lock, flags);
+
+	if (async_header_get_destination(packet->header) == ohci->node_id &&
+	    ohci->generation == packet->generation) {
+		spin_unlock_irqrestore(&ohci->lock, flags);
+
+		// Timestamping on behalf of the hardware.
+		packet->timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
+
+		handle_local_request(ctx, packet);
+		return;
+	}
+
+	ret = at_context_queue_packet(ctx, packet);
+	if (ret == 0)
+		at_context_wake(ctx);
+	spin_unlock_irqrestore(&ohci->lock, flags);
+
+	if (ret < 0) {
+		// Timestamping on behalf of the hardware.
+		packet->timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
+
+		packet->callback(packet, &ohci->card, packet->ack);
+	}
+}
+
+// Link all of packets in the list into the DMA program under a single acquisition of the lock,
+// then wake the context once. The list is consumed; the link member of each packet is free for
+// use by the caller again once the function returns.
+static void at_context_transmit_list(struct at_context *ctx, struct list_head *packets)
+{
+	struct fw_ohci *ohci = ctx->context.ohci;
+	struct fw_packet *packet, *next;
+	unsigned int queued = 0;
+	LIST_HEAD(local);
+	LIST_HEAD(failed);
+	unsigned long flags;
+
+	spin_lock_irqsave(&ohci->lock, flags);
+
+	list_for_each_entry_safe(packet, next, packets, link) {
+		if (async_header_get_destination(packet->header) == ohci->node_id &&
+		    ohci->generation == packet->generation) {
+			list_move_tail(&packet->link, &local);
+			continue;
+		}
+
+		// Unlink in advance since the packet can be completed as soon as it is linked to the
+		// DMA program of running context.
+		list_del_init(&packet->link);
+		if (at_context_queue_packet(ctx, packet) < 0) {
+			list_add_tail(&packet->link, &failed);
+			continue;
+		}
+		++queued;
+	}
 
-static void at_context_transmit(struct at_context *ctx, struct fw_packet *packet)
-{
-	struct fw_ohci *ohci = ctx->context.ohci;
-	unsigned long flags;
-	int ret;
+	if (queued > 0)
+		at_context_wake(ctx);
 
-	spin_lock_irqsave(&ohci->lock, flags);
+	spin_unlock_irqrestore(&ohci->lock, flags);
 
-	if (async_header_get_destination(packet->header) == ohci->node_id &&
-	    ohci->generation == packet->generation) {
-		spin_unlock_irqrestore(&ohci->lock, flags);
+	// The packets queued successfully may be completed in the meantime, therefore they are
+	// never dereferenced here.
+	list_for_each_entry_safe(packet, next, &local, link) {
+		list_del_init(&packet->link);
 
 		// Timestamping on behalf of the hardware.
-		packet->timestamp = cycle_time_to_ohci_tstamp(get_cycle_time(ohci));
+		packet->timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
 
 		handle_local_request(ctx, packet);
-		return;
 	}
 
-	ret = at_context_queue_packet(ctx, packet);
-	spin_unlock_irqrestore(&ohci->lock, flags);
+	list_for_each_entry_safe(packet, next, &failed, link) {
+		list_del_init(&packet->link);
 
-	if (ret < 0) {
 		// Timestamping on behalf of the hardware.
-		packet->timestamp = cycle_time_to_ohci_tstamp(get_cycle_time(ohci));
+		packet->timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
 
 		packet->callback(packet, &ohci->card, packet->ack);
 	}
 }
 
-static void detect_dead_context(struct fw_ohci *ohci,
-				const char *name, unsigned int regs)
+static void detect_dead_context(struct fw_ohci *ohci, const char *name, unsigned int regs,
+				struct context_stats *stats)
 {
 	static const char *const evts[] = {
 		[0x00] = "evt_no_status",	[0x01] = "-reserved-",
@@ -1627,9 +2367,11 @@ static void detect_dead_context(struct fw_ohci *ohci,
 	u32 ctl;
 
 	ctl = reg_read(ohci, CONTROL_SET(regs));
-	if (ctl & CONTEXT_DEAD)
+	if (ctl & CONTEXT_DEAD) {
 		ohci_err(ohci, "DMA context %s has stopped, error code: %s\n",
 			name, evts[ctl & 0x1f]);
+		WRITE_ONCE(stats->dead, stats->dead + 1);
+	}
 }
 
 static void handle_dead_contexts(struct fw_ohci *ohci)
@@ -1637,21 +2379,27 @@ static void handle_dead_contexts(struct fw_ohci *ohci)
 	unsigned int i;
 	char name[8];
 
-	detect_dead_context(ohci, "ATReq", OHCI1394_AsReqTrContextBase);
-	detect_dead_context(ohci, "ATRsp", OHCI1394_AsRspTrContextBase);
-	detect_dead_context(ohci, "ARReq", OHCI1394_AsReqRcvContextBase);
-	detect_dead_context(ohci, "ARRsp", OHCI1394_AsRspRcvContextBase);
+	detect_dead_context(ohci, "ATReq", OHCI1394_AsReqTrContextBase,
+			    &ohci->at_request_ctx.context.stats);
+	detect_dead_context(ohci, "ATRsp", OHCI1394_AsRspTrContextBase,
+			    &ohci->at_response_ctx.context.stats);
+	detect_dead_context(ohci, "ARReq", OHCI1394_AsReqRcvContextBase,
+			    &ohci->ar_request_ctx.stats);
+	detect_dead_context(ohci, "ARRsp", OHCI1394_AsRspRcvContextBase,
+			    &ohci->ar_response_ctx.stats);
 	for (i = 0; i < 32; ++i) {
 		if (!(ohci->it_context_support & (1 << i)))
 			continue;
 		sprintf(name, "IT%u", i);
-		detect_dead_context(ohci, name, OHCI1394_IsoXmitContextBase(i));
+		detect_dead_context(ohci, name, OHCI1394_IsoXmitContextBase(i),
+				    &ohci->it_context_list[i].context.stats);
 	}
 	for (i = 0; i < 32; ++i) {
 		if (!(ohci->ir_context_support & (1 << i)))
 			continue;
 		sprintf(name, "IR%u", i);
-		detect_dead_context(ohci, name, OHCI1394_IsoRcvContextBase(i));
+		detect_dead_context(ohci, name, OHCI1394_IsoRcvContextBase(i),
+				    &ohci->ir_context_list[i].context.stats);
 	}
 	/* TODO: maybe try to flush and restart the dead contexts */
 }
@@ -1687,6 +2435,8 @@ static u32 get_cycle_time(struct fw_ohci *ohci)
 	u32 c0, c1, c2;
 	u32 t0, t1, t2;
 	s32 diff01, diff12;
+	unsigned long flags;
+	ktime_t stamp;
 	int i;
 
 	if (has_reboot_by_cycle_timer_read_quirk(ohci))
@@ -1712,9 +2462,100 @@ static u32 get_cycle_time(struct fw_ohci *ohci)
 			 && i++ < 20);
 	}
 
+	stamp = ktime_get();
+
+	write_seqlock_irqsave(&ohci->cycle_time_snapshot.lock, flags);
+	ohci->cycle_time_snapshot.value = c2;
+	ohci->cycle_time_snapshot.stamp = stamp;
+	write_sequnlock_irqrestore(&ohci->cycle_time_snapshot.lock, flags);
+
 	return c2;
 }
 
+// The ratio between the clock of host system and the one of 1394 OHCI controller is not exactly 1,
+// while each of them is allowed to drift in 100 ppm. Within 1 msec since the snapshot, the error of
+// extrapolation is within 200 nsec, less than 5 ticks of 24.576 MHz.
+#define CYCLE_TIME_SNAPSHOT_MAX_AGE_NSEC	(1 * NSEC_PER_MSEC)
+
+#define CYCLE_TIMER_TICKS_PER_CYCLE	3072
+#define CYCLE_TIMER_TICKS_PER_SECOND	(CYCLE_TIMER_TICKS_PER_CYCLE * 8000)
+
+static u32 cycle_timer_from_ticks(u32 ticks)
+{
+	u32 seconds = ticks / CYCLE_TIMER_TICKS_PER_SECOND;
+	u32 cycles;
+
+	ticks %= CYCLE_TIMER_TICKS_PER_SECOND;
+	cycles = ticks / CYCLE_TIMER_TICKS_PER_CYCLE;
+	ticks %= CYCLE_TIMER_TICKS_PER_CYCLE;
+
+	return ((seconds & 0x7f) << 25) | (cycles << 12) | ticks;
+}
+
+static ktime_t read_cycle_time_snapshot(struct fw_ohci *ohci, u32 *value)
+{
+	unsigned int seq;
+	ktime_t stamp;
+
+	do {
+		seq = read_seqbegin(&ohci->cycle_time_snapshot.lock);
+		*value = ohci->cycle_time_snapshot.value;
+		stamp = ohci->cycle_time_snapshot.stamp;
+	} while (read_seqretry(&ohci->cycle_time_snapshot.lock, seq));
+
+	return stamp;
+}
+
+// Extrapolate the current cycle time from the last snapshot by the elapsed system time. When the
+// snapshot is too old or unavailable, read the register instead, which refreshes the snapshot.
+static u32 estimate_cycle_time(struct fw_ohci *ohci)
+{
+	u32 cycle_time;
+	ktime_t stamp;
+	s64 elapsed;
+	u32 ticks;
+
+	if (has_reboot_by_cycle_timer_read_quirk(ohci))
+		return 0;
+
+	stamp = read_cycle_time_snapshot(ohci, &cycle_time);
+	if (stamp == 0)
+		return get_cycle_time(ohci);
+
+	elapsed = ktime_to_ns(ktime_sub(ktime_get(), stamp));
+	if (elapsed < 0 || elapsed > CYCLE_TIME_SNAPSHOT_MAX_AGE_NSEC)
+		return get_cycle_time(ohci);
+
+	// The value of ticks is less than 128 seconds, thus never overflows.
+	ticks = cycle_timer_ticks(cycle_time) +
+		div_u64(elapsed * CYCLE_TIMER_TICKS_PER_CYCLE, ISOC_CYCLE_NSEC);
+
+	return cycle_timer_from_ticks(ticks);
+}
+
+// The cycle timer can be adjusted discontinuously by the cycle master after bus reset, or by the
+// write transaction to CYCLE_TIME register.
+static void invalidate_cycle_time_snapshot(struct fw_ohci *ohci)
+{
+	unsigned long flags;
+
+	write_seqlock_irqsave(&ohci->cycle_time_snapshot.lock, flags);
+	ohci->cycle_time_snapshot.stamp = 0;
+	write_sequnlock_irqrestore(&ohci->cycle_time_snapshot.lock, flags);
+}
+
+// Refresh the snapshot when it is going to be stale, so that the subsequent estimation does not
+// fall back to the register read.
+static void refresh_cycle_time_snapshot(struct fw_ohci *ohci)
+{
+	u32 cycle_time;
+	ktime_t stamp;
+
+	stamp = read_cycle_time_snapshot(ohci, &cycle_time);
+	if (ktime_to_ns(ktime_sub(ktime_get(), stamp)) >= CYCLE_TIME_SNAPSHOT_MAX_AGE_NSEC / 2)
+		(void)get_cycle_time(ohci);
+}
+
 /*
  * This function has to be called at least every 64 seconds.  The bus_time
  * field stores not only the upper 25 bits of the BUS_TIME register but also
@@ -1910,6 +2751,8 @@ static irqreturn_t handle_selfid_complete_event(int irq, void *data)
 			  OHCI1394_LinkControl_cycleMaster);
 	ohci->is_root = is_new_root;
 
+	invalidate_cycle_time_snapshot(ohci);
+
 	reg = reg_read(ohci, OHCI1394_SelfIDCount);
 	if (ohci1394_self_id_count_is_error(reg)) {
 		ohci_notice(ohci, "self ID receive error\n");
@@ -2098,8 +2941,13 @@ static irqreturn_t irq_handler(int irq, void *data)
 		reg_write(ohci, OHCI1394_IsoRecvIntEventClear, iso_event);
 
 		while (iso_event) {
+			struct iso_context *ctx;
+
 			i = ffs(iso_event) - 1;
-			fw_iso_context_schedule_flush_completions(&ohci->ir_context_list[i].base);
+			ctx = &ohci->ir_context_list[i];
+			if (READ_ONCE(ctx->coalescing.interval) > 0)
+				WRITE_ONCE(ctx->coalescing.irq_stamp, ktime_get());
+			fw_iso_context_schedule_flush_completions(&ctx->base);
 			iso_event &= ~(1 << i);
 		}
 	}
@@ -2115,6 +2963,9 @@ static irqreturn_t irq_handler(int irq, void *data)
 		}
 	}
 
+	if (event & (OHCI1394_isochRx | OHCI1394_isochTx))
+		refresh_cycle_time_snapshot(ohci);
+
 	if (unlikely(event & OHCI1394_regAccessFail))
 		ohci_err(ohci, "register access failure\n");
 
@@ -2326,6 +3177,7 @@ static int ohci_enable(struct fw_card *card,
 		  (200 << 16));
 
 	ohci->bus_time_running = false;
+	invalidate_cycle_time_snapshot(ohci);
 
 	for (i = 0; i < 32; i++)
 		if (ohci->ir_context_support & (1 << i))
@@ -2423,8 +3275,12 @@ static int ohci_enable(struct fw_card *card,
 		  OHCI1394_LinkControl_rcvSelfID |
 		  OHCI1394_LinkControl_rcvPhyPkt);
 
-	ar_context_run(&ohci->ar_request_ctx);
-	ar_context_run(&ohci->ar_response_ctx);
+	ret = ar_context_run(&ohci->ar_request_ctx);
+	if (ret < 0)
+		return ret;
+	ret = ar_context_run(&ohci->ar_response_ctx);
+	if (ret < 0)
+		return ret;
 
 	flush_writes(ohci);
 
@@ -2557,6 +3413,13 @@ static void ohci_send_request(struct fw_card *card, struct fw_packet *packet)
 	at_context_transmit(&ohci->at_request_ctx, packet);
 }
 
+static void ohci_send_requests(struct fw_card *card, struct list_head *packets)
+{
+	struct fw_ohci *ohci = fw_ohci(card);
+
+	at_context_transmit_list(&ohci->at_request_ctx, packets);
+}
+
 static void ohci_send_response(struct fw_card *card, struct fw_packet *packet)
 {
 	struct fw_ohci *ohci = fw_ohci(card);
@@ -2587,7 +3450,7 @@ static int ohci_cancel_packet(struct fw_card *card, struct fw_packet *packet)
 	packet->ack = RCODE_CANCELLED;
 
 	// Timestamping on behalf of the hardware.
-	packet->timestamp = cycle_time_to_ohci_tstamp(get_cycle_time(ohci));
+	packet->timestamp = cycle_time_to_ohci_tstamp(estimate_cycle_time(ohci));
 
 	packet->callback(packet, &ohci->card, packet->ack);
 	ret = 0;
@@ -2632,6 +3495,11 @@ static int ohci_enable_phys_dma(struct fw_card *card,
 	return ret;
 }
 
+static u32 ohci_estimate_cycle_time(struct fw_card *card)
+{
+	return estimate_cycle_time(fw_ohci(card));
+}
+
 static u32 ohci_read_csr(struct fw_card *card, int csr_offset)
 {
 	struct fw_ohci *ohci = fw_ohci(card);
@@ -2715,6 +3583,7 @@ static void ohci_write_csr(struct fw_card *card, int csr_offset, u32 value)
 		reg_write(ohci, OHCI1394_IntEventSet,
 			  OHCI1394_cycleInconsistent);
 		flush_writes(ohci);
+		invalidate_cycle_time_snapshot(ohci);
 		break;
 
 	case CSR_BUS_TIME:
@@ -2743,6 +3612,9 @@ static void ohci_write_csr(struct fw_card *card, int csr_offset, u32 value)
 
 static void flush_iso_completions(struct iso_context *ctx, enum fw_iso_context_completions_cause cause)
 {
+	// The consumer can read the payloads of completed packets in the callback.
+	flush_payload_sync_for_cpu(ctx);
+
 	trace_isoc_inbound_single_completions(&ctx->base, ctx->sc.last_timestamp, cause,
 					      ctx->sc.header, ctx->sc.header_length);
 	trace_isoc_outbound_completions(&ctx->base, ctx->sc.last_timestamp, cause, ctx->sc.header,
@@ -2799,17 +3671,15 @@ static int handle_ir_packet_per_buffer(struct context *context,
 	while (!(d->control & cpu_to_le16(DESCRIPTOR_BRANCH_ALWAYS))) {
 		d++;
 		buffer_dma = le32_to_cpu(d->data_address);
-		dma_sync_single_range_for_cpu(context->ohci->card.device,
-					      buffer_dma & PAGE_MASK,
-					      buffer_dma & ~PAGE_MASK,
-					      le16_to_cpu(d->req_count),
-					      DMA_FROM_DEVICE);
+		queue_payload_sync_for_cpu(ctx, buffer_dma, le16_to_cpu(d->req_count));
 	}
 
 	copy_iso_headers(ctx, (u32 *) (last + 1));
 
-	if (last->control & cpu_to_le16(DESCRIPTOR_IRQ_ALWAYS))
+	if (last->control & cpu_to_le16(DESCRIPTOR_IRQ_ALWAYS)) {
+		ctx->coalescing.points++;
 		flush_iso_completions(ctx, FW_ISO_CONTEXT_COMPLETIONS_CAUSE_INTERRUPT);
+	}
 
 	return 1;
 }
@@ -2838,10 +3708,11 @@ static int handle_ir_buffer_fill(struct context *context,
 		/* Descriptor(s) not done yet, stop iteration */
 		return 0;
 
-	dma_sync_single_range_for_cpu(context->ohci->card.device,
-				      buffer_dma & PAGE_MASK,
-				      buffer_dma & ~PAGE_MASK,
-				      completed, DMA_FROM_DEVICE);
+	if (ctx->cpu_sync.needed)
+		dma_sync_single_range_for_cpu(context->ohci->card.device,
+					      buffer_dma & PAGE_MASK,
+					      buffer_dma & ~PAGE_MASK,
+					      completed, DMA_FROM_DEVICE);
 
 	if (last->control & cpu_to_le16(DESCRIPTOR_IRQ_ALWAYS)) {
 		trace_isoc_inbound_multiple_completions(&ctx->base, completed,
@@ -2858,10 +3729,11 @@ static int handle_ir_buffer_fill(struct context *context,
 
 static void flush_ir_buffer_fill(struct iso_context *ctx)
 {
-	dma_sync_single_range_for_cpu(ctx->context.ohci->card.device,
-				      ctx->mc.buffer_bus & PAGE_MASK,
-				      ctx->mc.buffer_bus & ~PAGE_MASK,
-				      ctx->mc.completed, DMA_FROM_DEVICE);
+	if (ctx->cpu_sync.needed)
+		dma_sync_single_range_for_cpu(ctx->context.ohci->card.device,
+					      ctx->mc.buffer_bus & PAGE_MASK,
+					      ctx->mc.buffer_bus & ~PAGE_MASK,
+					      ctx->mc.completed, DMA_FROM_DEVICE);
 
 	trace_isoc_inbound_multiple_completions(&ctx->base, ctx->mc.completed,
 						FW_ISO_CONTEXT_COMPLETIONS_CAUSE_FLUSH);
@@ -2871,12 +3743,15 @@ static void flush_ir_buffer_fill(struct iso_context *ctx)
 	ctx->mc.completed = 0;
 }
 
-static inline void sync_it_packet_for_cpu(struct context *context,
+static inline void sync_it_packet_for_cpu(struct iso_context *ctx,
 					  struct descriptor *pd)
 {
 	__le16 control;
 	u32 buffer_dma;
 
+	if (!ctx->cpu_sync.needed)
+		return;
+
 	/* only packets beginning with OUTPUT_MORE* have data buffers */
 	if (pd->control & cpu_to_le16(DESCRIPTOR_BRANCH_ALWAYS))
 		return;
@@ -2890,7 +3765,7 @@ static inline void sync_it_packet_for_cpu(struct context *context,
 	 * be synced.
 	 */
 	if ((le32_to_cpu(pd->data_address) & PAGE_MASK) ==
-	    (context->current_bus          & PAGE_MASK)) {
+	    (ctx->context.current_bus      & PAGE_MASK)) {
 		if (pd->control & cpu_to_le16(DESCRIPTOR_BRANCH_ALWAYS))
 			return;
 		pd++;
@@ -2898,11 +3773,7 @@ static inline void sync_it_packet_for_cpu(struct context *context,
 
 	do {
 		buffer_dma = le32_to_cpu(pd->data_address);
-		dma_sync_single_range_for_cpu(context->ohci->card.device,
-					      buffer_dma & PAGE_MASK,
-					      buffer_dma & ~PAGE_MASK,
-					      le16_to_cpu(pd->req_count),
-					      DMA_TO_DEVICE);
+		queue_payload_sync_for_cpu(ctx, buffer_dma, le16_to_cpu(pd->req_count));
 		control = pd->control;
 		pd++;
 	} while (!(control & cpu_to_le16(DESCRIPTOR_BRANCH_ALWAYS)));
@@ -2924,7 +3795,7 @@ static int handle_it_packet(struct context *context,
 		/* Descriptor(s) not done yet, stop iteration */
 		return 0;
 
-	sync_it_packet_for_cpu(context, d);
+	sync_it_packet_for_cpu(ctx, d);
 
 	if (ctx->sc.header_length + 4 > ctx->base.header_storage_size) {
 		if (ctx->base.flags & FW_ISO_CONTEXT_FLAG_DROP_OVERFLOW_HEADERS)
@@ -2945,6 +3816,54 @@ static int handle_it_packet(struct context *context,
 	return 1;
 }
 
+// The descriptor block for each slot of the ring program consists of OUTPUT_MORE_IMMEDIATE with
+// the header of isochronous packet, and OUTPUT_LAST for the payload in the slot.
+#define IT_RING_SLOT_Z	3
+
+// The controller writes the status to the last descriptor of slot whenever transmitting the slot.
+// Clear it after reporting so that the slot is detected as completed again in the next round.
+static unsigned int it_ring_retire_slots(struct iso_context *ctx)
+{
+	unsigned int retired = 0;
+	u64 start = ktime_get_ns();
+
+	while (retired < ctx->ring.slots) {
+		struct descriptor *last = ctx->ring.descriptors +
+					  ctx->ring.next * IT_RING_SLOT_Z + IT_RING_SLOT_Z - 1;
+		u16 status = le16_to_cpu(READ_ONCE(last->transfer_status));
+		u16 timestamp = le16_to_cpu(READ_ONCE(last->res_count));
+
+		if (status == 0)
+			break;
+
+		if (ctx->sc.header_length + 4 > ctx->base.header_storage_size &&
+		    !(ctx->base.flags & FW_ISO_CONTEXT_FLAG_DROP_OVERFLOW_HEADERS))
+			flush_iso_completions(ctx, FW_ISO_CONTEXT_COMPLETIONS_CAUSE_HEADER_OVERFLOW);
+
+		if (ctx->sc.header_length + 4 <= ctx->base.header_storage_size) {
+			__be32 *ctx_hdr = ctx->sc.header + ctx->sc.header_length;
+
+			ctx->sc.last_timestamp = timestamp;
+			/* Present this value as big-endian to match the receive code */
+			*ctx_hdr = cpu_to_be32((status << 16) | timestamp);
+			ctx->sc.header_length += 4;
+		}
+
+		WRITE_ONCE(last->transfer_status, 0);
+		ctx->ring.next = (ctx->ring.next + 1) % ctx->ring.slots;
+		++retired;
+
+		if (last->control & cpu_to_le16(DESCRIPTOR_IRQ_ALWAYS))
+			flush_iso_completions(ctx, FW_ISO_CONTEXT_COMPLETIONS_CAUSE_INTERRUPT);
+	}
+
+	// Each retired slot is queued again at the same time.
+	context_stats_retire(&ctx->context.stats, retired * IT_RING_SLOT_Z, ktime_get_ns() - start);
+	context_stats_queue(&ctx->context.stats, retired * IT_RING_SLOT_Z);
+
+	return retired;
+}
+
 static void set_multichannel_mask(struct fw_ohci *ohci, u64 channels)
 {
 	u32 hi = channels >> 32, lo = channels;
@@ -3055,6 +3974,164 @@ static struct fw_iso_context *ohci_allocate_iso_context(struct fw_card *card, in
 	return ERR_PTR(ret);
 }
 
+// The maximum number of descriptors for an isochronous packet, as queue_iso_transmit(),
+// queue_iso_packet_per_buffer(), and queue_iso_buffer_fill() build. The payload is split at the
+// boundary of chunks in the buffer, thus at the boundary of any page in the worst case.
+static unsigned int iso_descriptors_per_packet(const struct iso_context *ctx, size_t header_length,
+					       size_t payload_length)
+{
+	unsigned int payload_z = 0;
+
+	if (payload_length > 0)
+		payload_z = DIV_ROUND_UP(payload_length, PAGE_SIZE) + 1;
+
+	switch (ctx->base.type) {
+	case FW_ISO_CONTEXT_TRANSMIT:
+		// The immediate descriptor takes two, the descriptor for header, then the header
+		// quadlets stored after the descriptors.
+		return 2 + (header_length > 0) + payload_z +
+		       DIV_ROUND_UP(header_length, sizeof(struct descriptor));
+	case FW_ISO_CONTEXT_RECEIVE:
+		// The descriptor for header, then the storage of header after the descriptors.
+		return 1 + payload_z +
+		       DIV_ROUND_UP(max(ctx->base.header_size, (size_t)8), sizeof(struct descriptor));
+	case FW_ISO_CONTEXT_RECEIVE_MULTICHANNEL:
+	default:
+		return max(payload_z, 1U);
+	}
+}
+
+static int ohci_reserve_iso_descriptors(struct fw_iso_context *base, unsigned int packets,
+					size_t header_length, size_t payload_length)
+{
+	struct iso_context *ctx = container_of(base, struct iso_context, base);
+
+	return context_reserve_buffers(&ctx->context, (unsigned long)packets *
+				       iso_descriptors_per_packet(ctx, header_length,
+								  payload_length));
+}
+
+static void it_ring_release(struct iso_context *ctx)
+{
+	if (!ctx->ring.descriptors)
+		return;
+
+	dma_free_coherent(ctx->context.ohci->card.device,
+			  ctx->ring.slots * IT_RING_SLOT_Z * sizeof(struct descriptor),
+			  ctx->ring.descriptors, ctx->ring.descriptors_bus);
+	ctx->ring.descriptors = NULL;
+}
+
+// Rewind the ring program to transmit from the first slot at next start.
+static void it_ring_rewind(struct iso_context *ctx)
+{
+	unsigned int i;
+
+	for (i = 0; i < ctx->ring.slots; ++i)
+		ctx->ring.descriptors[i * IT_RING_SLOT_Z + IT_RING_SLOT_Z - 1].transfer_status = 0;
+	ctx->ring.next = 0;
+}
+
+static int ohci_create_iso_ring_program(struct fw_iso_context *base, struct fw_iso_buffer *buffer,
+					unsigned int slots, unsigned int slot_size,
+					unsigned int irq_interval, int tag)
+{
+	struct iso_context *ctx = container_of(base, struct iso_context, base);
+	struct fw_ohci *ohci = ctx->context.ohci;
+	struct device *device = ohci->card.device;
+	unsigned int slots_per_page = PAGE_SIZE / slot_size;
+	struct descriptor *descriptors;
+	dma_addr_t descriptors_bus;
+	unsigned int i;
+
+	// The loop replaces the DMA program built by queueing packets.
+	if (ctx->ring.descriptors || ctx->context.last->branch_address != 0)
+		return -EBUSY;
+
+	descriptors = dma_alloc_coherent(device, slots * IT_RING_SLOT_Z * sizeof(*descriptors),
+					 &descriptors_bus, GFP_KERNEL);
+	if (!descriptors)
+		return -ENOMEM;
+
+	for (i = 0; i < slots; ++i) {
+		struct descriptor *d = descriptors + i * IT_RING_SLOT_Z;
+		dma_addr_t d_bus = descriptors_bus + i * IT_RING_SLOT_Z * sizeof(*d);
+		dma_addr_t next_bus = descriptors_bus +
+				      ((i + 1) % slots) * IT_RING_SLOT_Z * sizeof(*d);
+		unsigned int page = i / slots_per_page;
+		unsigned int offset = (i % slots_per_page) * slot_size;
+		__le32 *header = (__le32 *)&d[1];
+		u16 irq;
+
+		d[0].control = cpu_to_le16(DESCRIPTOR_KEY_IMMEDIATE);
+		d[0].req_count = cpu_to_le16(8);
+		// Skip the cycle whenever lost cycles or FIFO overruns occur, as the queued packet.
+		d[0].branch_address = cpu_to_le32(d_bus | IT_RING_SLOT_Z);
+
+		ohci1394_it_data_set_speed(header, base->speed);
+		ohci1394_it_data_set_tag(header, tag);
+		ohci1394_it_data_set_channel(header, base->channel);
+		ohci1394_it_data_set_tcode(header, TCODE_STREAM_DATA);
+		ohci1394_it_data_set_sync(header, 0);
+		ohci1394_it_data_set_data_length(header, slot_size);
+
+		irq = (i + 1) % irq_interval == 0 ? DESCRIPTOR_IRQ_ALWAYS : DESCRIPTOR_NO_IRQ;
+		d[2].control = cpu_to_le16(DESCRIPTOR_OUTPUT_LAST | DESCRIPTOR_STATUS |
+					   DESCRIPTOR_BRANCH_ALWAYS | irq);
+		d[2].req_count = cpu_to_le16(slot_size);
+		d[2].data_address = cpu_to_le32(buffer->dma_addrs[page] + offset);
+		d[2].branch_address = cpu_to_le32(next_bus | IT_RING_SLOT_Z);
+	}
+
+	if (buffer->need_sync) {
+		for (i = 0; i < DIV_ROUND_UP(slots, slots_per_page); ++i)
+			dma_sync_single_for_device(device, buffer->dma_addrs[i], PAGE_SIZE,
+						   DMA_TO_DEVICE);
+	}
+
+	wmb(); /* finish init of new descriptors before branch_address update */
+
+	guard(spinlock_irqsave)(&ohci->lock);
+
+	ctx->ring.descriptors = descriptors;
+	ctx->ring.descriptors_bus = descriptors_bus;
+	ctx->ring.buffer = buffer;
+	ctx->ring.slots = slots;
+	ctx->ring.slot_size = slot_size;
+	ctx->ring.next = 0;
+
+	// The context starts at the branch address of the last descriptor.
+	ctx->context.last->branch_address = cpu_to_le32(descriptors_bus | IT_RING_SLOT_Z);
+	context_stats_queue(&ctx->context.stats, slots * IT_RING_SLOT_Z);
+
+	return 0;
+}
+
+static int ohci_update_iso_ring_slot(struct fw_iso_context *base, unsigned int index,
+				     unsigned int length)
+{
+	struct iso_context *ctx = container_of(base, struct iso_context, base);
+	struct descriptor *d;
+	unsigned long offset;
+
+	if (!ctx->ring.descriptors || index >= ctx->ring.slots || length > ctx->ring.slot_size)
+		return -EINVAL;
+
+	offset = fw_iso_ring_slot_offset(ctx->ring.slot_size, index);
+	if (ctx->ring.buffer->need_sync)
+		dma_sync_single_range_for_device(ctx->context.ohci->card.device,
+						 ctx->ring.buffer->dma_addrs[offset >> PAGE_SHIFT],
+						 offset & ~PAGE_MASK, length, DMA_TO_DEVICE);
+
+	wmb(); /* finish the payload before the length of packet */
+
+	d = ctx->ring.descriptors + index * IT_RING_SLOT_Z;
+	ohci1394_it_data_set_data_length((__le32 *)&d[1], length);
+	d[2].req_count = cpu_to_le16(length);
+
+	return 0;
+}
+
 static int ohci_start_iso(struct fw_iso_context *base,
 			  s32 cycle, u32 sync, u32 tags)
 {
@@ -3067,6 +4144,9 @@ static int ohci_start_iso(struct fw_iso_context *base,
 	if (ctx->context.last->branch_address == 0)
 		return -ENODATA;
 
+	// Start with the minimum interval again, instead of the one adapted in the last run.
+	reset_irq_coalescing(ctx);
+
 	switch (ctx->base.type) {
 	case FW_ISO_CONTEXT_TRANSMIT:
 		index = ctx - ohci->it_context_list;
@@ -3075,8 +4155,12 @@ static int ohci_start_iso(struct fw_iso_context *base,
 			match = IT_CONTEXT_CYCLE_MATCH_ENABLE |
 				(cycle & 0x7fff) << 16;
 
+		if (ctx->ring.descriptors)
+			it_ring_rewind(ctx);
+
 		reg_write(ohci, OHCI1394_IsoXmitIntEventClear, 1 << index);
-		reg_write(ohci, OHCI1394_IsoXmitIntMaskSet, 1 << index);
+		if (!(ctx->base.flags & FW_ISO_CONTEXT_FLAG_POLLING))
+			reg_write(ohci, OHCI1394_IsoXmitIntMaskSet, 1 << index);
 		context_run(&ctx->context, match);
 		break;
 
@@ -3092,7 +4176,8 @@ static int ohci_start_iso(struct fw_iso_context *base,
 		}
 
 		reg_write(ohci, OHCI1394_IsoRecvIntEventClear, 1 << index);
-		reg_write(ohci, OHCI1394_IsoRecvIntMaskSet, 1 << index);
+		if (!(ctx->base.flags & FW_ISO_CONTEXT_FLAG_POLLING))
+			reg_write(ohci, OHCI1394_IsoRecvIntMaskSet, 1 << index);
 		reg_write(ohci, CONTEXT_MATCH(ctx->context.regs), match);
 		context_run(&ctx->context, control);
 
@@ -3136,6 +4221,7 @@ static void ohci_free_iso_context(struct fw_iso_context *base)
 	int index;
 
 	ohci_stop_iso(base);
+	it_ring_release(ctx);
 	context_release(&ctx->context);
 
 	if (base->type != FW_ISO_CONTEXT_RECEIVE_MULTICHANNEL) {
@@ -3208,6 +4294,23 @@ static void __maybe_unused ohci_resume_iso_dma(struct fw_ohci *ohci)
 	}
 }
 
+// The number of descriptors for the payload, split at the boundary of DMA-contiguous regions.
+static unsigned int count_payload_fragments(const struct fw_iso_buffer *buffer,
+					    unsigned long payload, unsigned long length)
+{
+	unsigned int count = 0;
+
+	while (length > 0) {
+		unsigned long fragment = fw_iso_buffer_contiguous_length(buffer, payload, length);
+
+		payload += fragment;
+		length -= fragment;
+		++count;
+	}
+
+	return count;
+}
+
 static int queue_iso_transmit(struct iso_context *ctx,
 			      struct fw_iso_packet *packet,
 			      struct fw_iso_buffer *buffer,
@@ -3218,11 +4321,13 @@ static int queue_iso_transmit(struct iso_context *ctx,
 	__le32 *header;
 	dma_addr_t d_bus;
 	u32 z, header_z, payload_z, irq;
-	u32 payload_index, payload_end_index, next_page_index;
-	int page, end_page, i, length, offset;
+	u32 payload_index, payload_end_index;
+	int page, i, length, offset;
+	bool need_sync;
 
 	p = packet;
 	payload_index = payload;
+	need_sync = fw_iso_context_payload_need_sync(&ctx->base, buffer, payload, p->payload_length);
 
 	if (p->skip)
 		z = 1;
@@ -3231,12 +4336,7 @@ static int queue_iso_transmit(struct iso_context *ctx,
 	if (p->header_length > 0)
 		z++;
 
-	/* Determine the first page the payload isn't contained in. */
-	end_page = PAGE_ALIGN(payload_index + p->payload_length) >> PAGE_SHIFT;
-	if (p->payload_length > 0)
-		payload_z = end_page - (payload_index >> PAGE_SHIFT);
-	else
-		payload_z = 0;
+	payload_z = count_payload_fragments(buffer, payload_index, p->payload_length);
 
 	z += payload_z;
 
@@ -3244,8 +4344,8 @@ static int queue_iso_transmit(struct iso_context *ctx,
 	header_z = DIV_ROUND_UP(p->header_length, sizeof(*d));
 
 	d = context_get_descriptors(&ctx->context, z + header_z, &d_bus);
-	if (d == NULL)
-		return -ENOMEM;
+	if (IS_ERR(d))
+		return PTR_ERR(d);
 
 	if (!p->skip) {
 		d[0].control   = cpu_to_le16(DESCRIPTOR_KEY_IMMEDIATE);
@@ -3281,17 +4381,17 @@ static int queue_iso_transmit(struct iso_context *ctx,
 	for (i = 0; i < payload_z; i++) {
 		page               = payload_index >> PAGE_SHIFT;
 		offset             = payload_index & ~PAGE_MASK;
-		next_page_index    = (page + 1) << PAGE_SHIFT;
-		length             =
-			min(next_page_index, payload_end_index) - payload_index;
+		length             = fw_iso_buffer_contiguous_length(buffer, payload_index,
+						payload_end_index - payload_index);
 		pd[i].req_count    = cpu_to_le16(length);
 
 		dma_addr_t dma_addr = buffer->dma_addrs[page];
 		pd[i].data_address = cpu_to_le32(dma_addr + offset);
 
-		dma_sync_single_range_for_device(ctx->context.ohci->card.device,
-						 dma_addr, offset, length,
-						 DMA_TO_DEVICE);
+		if (need_sync)
+			dma_sync_single_range_for_device(ctx->context.ohci->card.device,
+							 dma_addr, offset, length,
+							 DMA_TO_DEVICE);
 
 		payload_index += length;
 	}
@@ -3323,6 +4423,7 @@ static int queue_iso_packet_per_buffer(struct iso_context *ctx,
 	u32 z, header_z, rest;
 	int i, j, length;
 	int page, offset, packet_count, header_size, payload_per_buffer;
+	bool need_sync;
 
 	/*
 	 * The OHCI controller puts the isochronous header and trailer in the
@@ -3333,17 +4434,23 @@ static int queue_iso_packet_per_buffer(struct iso_context *ctx,
 
 	/* Get header size in number of descriptors. */
 	header_z = DIV_ROUND_UP(header_size, sizeof(*d));
-	page     = payload >> PAGE_SHIFT;
-	offset   = payload & ~PAGE_MASK;
 	payload_per_buffer = packet->payload_length / packet_count;
+	need_sync = fw_iso_context_payload_need_sync(&ctx->base, buffer, payload,
+						     packet->payload_length);
+
+	// The interrupt flag of packet is ignored in the mode of adaptive interrupt coalescing.
+	if (ctx->base.irq_interval.max > 0 && ctx->coalescing.interval == 0) {
+		WRITE_ONCE(ctx->coalescing.interval, ctx->base.irq_interval.min);
+		ctx->coalescing.countdown = ctx->base.irq_interval.min;
+	}
 
 	for (i = 0; i < packet_count; i++) {
 		/* d points to the header descriptor */
-		z = DIV_ROUND_UP(payload_per_buffer + offset, PAGE_SIZE) + 1;
+		z = count_payload_fragments(buffer, payload, payload_per_buffer) + 1;
 		d = context_get_descriptors(&ctx->context,
 				z + header_z, &d_bus);
-		if (d == NULL)
-			return -ENOMEM;
+		if (IS_ERR(d))
+			return PTR_ERR(d);
 
 		d->control      = cpu_to_le16(DESCRIPTOR_STATUS |
 					      DESCRIPTOR_INPUT_MORE);
@@ -3361,10 +4468,9 @@ static int queue_iso_packet_per_buffer(struct iso_context *ctx,
 			pd->control = cpu_to_le16(DESCRIPTOR_STATUS |
 						  DESCRIPTOR_INPUT_MORE);
 
-			if (offset + rest < PAGE_SIZE)
-				length = rest;
-			else
-				length = PAGE_SIZE - offset;
+			page = payload >> PAGE_SHIFT;
+			offset = payload & ~PAGE_MASK;
+			length = fw_iso_buffer_contiguous_length(buffer, payload, rest);
 			pd->req_count = cpu_to_le16(length);
 			pd->res_count = pd->req_count;
 			pd->transfer_status = 0;
@@ -3372,20 +4478,25 @@ static int queue_iso_packet_per_buffer(struct iso_context *ctx,
 			dma_addr_t dma_addr = buffer->dma_addrs[page];
 			pd->data_address = cpu_to_le32(dma_addr + offset);
 
-			dma_sync_single_range_for_device(device, dma_addr,
-							 offset, length,
-							 DMA_FROM_DEVICE);
+			if (need_sync)
+				dma_sync_single_range_for_device(device, dma_addr,
+								 offset, length,
+								 DMA_FROM_DEVICE);
 
-			offset = (offset + length) & ~PAGE_MASK;
+			payload += length;
 			rest -= length;
-			if (offset == 0)
-				page++;
 		}
 		pd->control = cpu_to_le16(DESCRIPTOR_STATUS |
 					  DESCRIPTOR_INPUT_LAST |
 					  DESCRIPTOR_BRANCH_ALWAYS);
-		if (packet->interrupt && i == packet_count - 1)
+		if (ctx->base.irq_interval.max > 0) {
+			if (--ctx->coalescing.countdown == 0) {
+				ctx->coalescing.countdown = READ_ONCE(ctx->coalescing.interval);
+				pd->control |= cpu_to_le16(DESCRIPTOR_IRQ_ALWAYS);
+			}
+		} else if (packet->interrupt && i == packet_count - 1) {
 			pd->control |= cpu_to_le16(DESCRIPTOR_IRQ_ALWAYS);
+		}
 
 		context_append(&ctx->context, d, z, header_z);
 	}
@@ -3401,10 +4512,12 @@ static int queue_iso_buffer_fill(struct iso_context *ctx,
 	struct descriptor *d;
 	dma_addr_t d_bus;
 	int page, offset, rest, z, i, length;
+	bool need_sync;
 
 	page   = payload >> PAGE_SHIFT;
 	offset = payload & ~PAGE_MASK;
 	rest   = packet->payload_length;
+	need_sync = fw_iso_context_payload_need_sync(&ctx->base, buffer, payload, rest);
 
 	/* We need one descriptor for each page in the buffer. */
 	z = DIV_ROUND_UP(offset + rest, PAGE_SIZE);
@@ -3414,8 +4527,8 @@ static int queue_iso_buffer_fill(struct iso_context *ctx,
 
 	for (i = 0; i < z; i++) {
 		d = context_get_descriptors(&ctx->context, 1, &d_bus);
-		if (d == NULL)
-			return -ENOMEM;
+		if (IS_ERR(d))
+			return PTR_ERR(d);
 
 		d->control = cpu_to_le16(DESCRIPTOR_INPUT_MORE |
 					 DESCRIPTOR_BRANCH_ALWAYS);
@@ -3435,9 +4548,10 @@ static int queue_iso_buffer_fill(struct iso_context *ctx,
 		dma_addr_t dma_addr = buffer->dma_addrs[page];
 		d->data_address = cpu_to_le32(dma_addr + offset);
 
-		dma_sync_single_range_for_device(ctx->context.ohci->card.device,
-						 dma_addr, offset, length,
-						 DMA_FROM_DEVICE);
+		if (need_sync)
+			dma_sync_single_range_for_device(ctx->context.ohci->card.device,
+							 dma_addr, offset, length,
+							 DMA_FROM_DEVICE);
 
 		rest -= length;
 		offset = 0;
@@ -3458,8 +4572,15 @@ static int ohci_queue_iso(struct fw_iso_context *base,
 
 	guard(spinlock_irqsave)(&ctx->context.ohci->lock);
 
+	// The completed payloads require synchronization for CPU as long as the buffer requires it.
+	if (buffer->need_sync)
+		ctx->cpu_sync.needed = true;
+
 	switch (base->type) {
 	case FW_ISO_CONTEXT_TRANSMIT:
+		// The DMA program is built as a closed loop already.
+		if (ctx->ring.descriptors)
+			return -EBUSY;
 		return queue_iso_transmit(ctx, packet, buffer, payload);
 	case FW_ISO_CONTEXT_RECEIVE:
 		return queue_iso_packet_per_buffer(ctx, packet, buffer, payload);
@@ -3484,7 +4605,21 @@ static int ohci_flush_iso_completions(struct fw_iso_context *base)
 	int ret = 0;
 
 	if (!test_and_set_bit_lock(0, &ctx->flushing_completions)) {
-		ohci_isoc_context_work(&base->work);
+		if (base->flags & FW_ISO_CONTEXT_FLAG_POLLING) {
+			struct fw_iso_context_poll_stats *stats = &base->poll_stats;
+			unsigned int retired = iso_context_retire(ctx);
+
+			// Exposed in debugfs.
+			WRITE_ONCE(stats->polls, stats->polls + 1);
+			if (retired == 0)
+				WRITE_ONCE(stats->empty_polls, stats->empty_polls + 1);
+			WRITE_ONCE(stats->retired, stats->retired + retired);
+			if (retired > stats->max_retired)
+				WRITE_ONCE(stats->max_retired, retired);
+		} else {
+			iso_context_retire(ctx);
+			discard_irq_coalescing_sample(ctx);
+		}
 
 		switch (base->type) {
 		case FW_ISO_CONTEXT_TRANSMIT:
@@ -3514,14 +4649,21 @@ static const struct fw_card_driver ohci_driver = {
 	.update_phy_reg		= ohci_update_phy_reg,
 	.set_config_rom		= ohci_set_config_rom,
 	.send_request		= ohci_send_request,
+	.send_requests		= ohci_send_requests,
 	.send_response		= ohci_send_response,
 	.cancel_packet		= ohci_cancel_packet,
+	.lend_payload		= ohci_lend_payload,
+	.return_payload		= ohci_return_payload,
 	.enable_phys_dma	= ohci_enable_phys_dma,
 	.read_csr		= ohci_read_csr,
+	.estimate_cycle_time	= ohci_estimate_cycle_time,
 	.write_csr		= ohci_write_csr,
 
 	.allocate_iso_context	= ohci_allocate_iso_context,
 	.free_iso_context	= ohci_free_iso_context,
+	.reserve_iso_descriptors = ohci_reserve_iso_descriptors,
+	.create_iso_ring_program = ohci_create_iso_ring_program,
+	.update_iso_ring_slot	= ohci_update_iso_ring_slot,
 	.set_iso_channels	= ohci_set_iso_channels,
 	.queue_iso		= ohci_queue_iso,
 	.flush_queue_iso	= ohci_flush_queue_iso,
@@ -3572,6 +4714,85 @@ static void release_ohci(struct device *dev, void *data)
 	dev_notice(dev, "removed fw-ohci device\n");
 }
 
+static int context_stats_show(struct seq_file *m, void *data)
+{
+	const struct context_stats *stats = m->private;
+	u64 retired, queued;
+	unsigned int i;
+
+	// Read in the order opposite to the update so that the depth is not negative.
+	retired = READ_ONCE(stats->retired);
+	queued = READ_ONCE(stats->queued);
+
+	seq_printf(m, "queued: %llu\n", queued);
+	seq_printf(m, "retired: %llu\n", retired);
+	seq_printf(m, "depth: %llu\n", queued - retired);
+	seq_printf(m, "high_watermark: %llu\n", READ_ONCE(stats->high_watermark));
+	seq_printf(m, "dead: %lu\n", READ_ONCE(stats->dead));
+	seq_printf(m, "callback_nsec: %llu\n", READ_ONCE(stats->callback_nsec));
+	seq_printf(m, "callback_max_nsec: %llu\n", READ_ONCE(stats->callback_max_nsec));
+
+	seq_puts(m, "retire_batches:\n");
+	seq_printf(m, "  0: %llu\n", READ_ONCE(stats->batches[0]));
+	for (i = 1; i < CONTEXT_STATS_BATCH_BUCKETS - 1; ++i) {
+		seq_printf(m, "  %u-%u: %llu\n", 1U << (i - 1), (1U << i) - 1,
+			   READ_ONCE(stats->batches[i]));
+	}
+	seq_printf(m, "  %u-: %llu\n", 1U << (i - 1), READ_ONCE(stats->batches[i]));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(context_stats);
+
+static int poll_stats_show(struct seq_file *m, void *data)
+{
+	const struct fw_iso_context_poll_stats *stats = m->private;
+
+	seq_printf(m, "polls: %llu\n", READ_ONCE(stats->polls));
+	seq_printf(m, "empty_polls: %llu\n", READ_ONCE(stats->empty_polls));
+	seq_printf(m, "retired: %llu\n", READ_ONCE(stats->retired));
+	seq_printf(m, "max_retired: %u\n", READ_ONCE(stats->max_retired));
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(poll_stats);
+
+// The entries are removed by the core together with the directory of card.
+static void ohci_debugfs_init(struct fw_ohci *ohci)
+{
+	struct dentry *dir;
+	char name[16];
+	int i;
+
+	dir = debugfs_create_dir("ohci", ohci->card.debugfs_dir);
+
+	debugfs_create_file("ar_request", 0444, dir, &ohci->ar_request_ctx.stats,
+			    &context_stats_fops);
+	debugfs_create_file("ar_response", 0444, dir, &ohci->ar_response_ctx.stats,
+			    &context_stats_fops);
+	debugfs_create_file("at_request", 0444, dir, &ohci->at_request_ctx.context.stats,
+			    &context_stats_fops);
+	debugfs_create_file("at_response", 0444, dir, &ohci->at_response_ctx.context.stats,
+			    &context_stats_fops);
+
+	for (i = 0; i < ohci->n_it; ++i) {
+		snprintf(name, sizeof(name), "it%d", i);
+		debugfs_create_file(name, 0444, dir, &ohci->it_context_list[i].context.stats,
+				    &context_stats_fops);
+		snprintf(name, sizeof(name), "it%d_poll", i);
+		debugfs_create_file(name, 0444, dir, &ohci->it_context_list[i].base.poll_stats,
+				    &poll_stats_fops);
+	}
+	for (i = 0; i < ohci->n_ir; ++i) {
+		snprintf(name, sizeof(name), "ir%d", i);
+		debugfs_create_file(name, 0444, dir, &ohci->ir_context_list[i].context.stats,
+				    &context_stats_fops);
+		snprintf(name, sizeof(name), "ir%d_poll", i);
+		debugfs_create_file(name, 0444, dir, &ohci->ir_context_list[i].base.poll_stats,
+				    &poll_stats_fops);
+	}
+}
+
 static int pci_probe(struct pci_dev *dev,
 			       const struct pci_device_id *ent)
 {
@@ -3603,6 +4824,7 @@ static int pci_probe(struct pci_dev *dev,
 	pci_write_config_dword(dev, OHCI1394_PCI_HCI_Control, 0);
 
 	spin_lock_init(&ohci->lock);
+	seqlock_init(&ohci->cycle_time_snapshot.lock);
 	mutex_init(&ohci->phy_reg_mutex);
 
 	if (!(pci_resource_flags(dev, 0) & IORESOURCE_MEM) ||
@@ -3637,7 +4859,6 @@ static int pci_probe(struct pci_dev *dev,
 	 * we save space by using a common buffer for the AR request/
 	 * response descriptors and the self IDs buffer.
 	 */
-	BUILD_BUG_ON(AR_BUFFERS * sizeof(struct descriptor) > PAGE_SIZE/4);
 	BUILD_BUG_ON(SELF_ID_BUF_SIZE > PAGE_SIZE/2);
 	ohci->misc_buffer = dmam_alloc_coherent(&dev->dev, PAGE_SIZE, &ohci->misc_buffer_bus,
 						GFP_KERNEL);
@@ -3645,12 +4866,12 @@ static int pci_probe(struct pci_dev *dev,
 		return -ENOMEM;
 
 	err = ar_context_init(&ohci->ar_request_ctx, ohci, 0,
-			      OHCI1394_AsReqRcvContextControlSet);
+			      OHCI1394_AsReqRcvContextControlSet, READ_ONCE(param_ar_buffer_size));
 	if (err < 0)
 		return err;
 
 	err = ar_context_init(&ohci->ar_response_ctx, ohci, PAGE_SIZE/4,
-			      OHCI1394_AsRspRcvContextControlSet);
+			      OHCI1394_AsRspRcvContextControlSet, READ_ONCE(param_ar_buffer_size));
 	if (err < 0)
 		return err;
 
@@ -3666,6 +4887,19 @@ static int pci_probe(struct pci_dev *dev,
 		return err;
 	INIT_WORK(&ohci->at_response_ctx.work, ohci_at_context_work);
 
+	// Each packet consumes 4 descriptors in AT context.
+	if (param_at_ring_depth > 0) {
+		err = context_reserve_buffers(&ohci->at_request_ctx.context,
+					      (unsigned long)param_at_ring_depth * 4);
+		if (err < 0)
+			return err;
+
+		err = context_reserve_buffers(&ohci->at_response_ctx.context,
+					      (unsigned long)param_at_ring_depth * 4);
+		if (err < 0)
+			return err;
+	}
+
 	reg_write(ohci, OHCI1394_IsoRecvIntMaskSet, ~0);
 	ohci->ir_context_channels = ~0ULL;
 	ohci->ir_context_support = reg_read(ohci, OHCI1394_IsoRecvIntMaskSet);
@@ -3725,6 +4959,8 @@ static int pci_probe(struct pci_dev *dev,
 	if (err)
 		goto fail_irq;
 
+	ohci_debugfs_init(ohci);
+
 	version = reg_read(ohci, OHCI1394_Version) & 0x00ff00ff;
 	ohci_notice(ohci,
 		    "added OHCI v%x.%x device as card %d, "
@@ -3806,12 +5042,88 @@ MODULE_DEVICE_TABLE(pci, pci_table);
 
 static SIMPLE_DEV_PM_OPS(pci_pm_ops, pci_suspend, pci_resume);
 
+static ssize_t ar_buffer_size_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct fw_ohci *ohci = pci_get_drvdata(to_pci_dev(dev));
+
+	return sysfs_emit(buf, "%zu %zu\n",
+			  ohci->ar_request_ctx.buffer_count * ohci->ar_request_ctx.buffer_size,
+			  ohci->ar_response_ctx.buffer_count * ohci->ar_response_ctx.buffer_size);
+}
+
+// Either one value for both contexts or two values for each context is acceptable. The buffer is
+// reallocated immediately with the AR context stopped shortly. -EBUSY is returned while any payload
+// in the buffer is referred by the core; e.g. the request to the address handler of userspace
+// client is not responded yet.
+static ssize_t ar_buffer_size_store(struct device *dev, struct device_attribute *attr,
+				    const char *buf, size_t count)
+{
+	struct fw_ohci *ohci = pci_get_drvdata(to_pci_dev(dev));
+	unsigned int request_size, response_size;
+	int err;
+
+	switch (sscanf(buf, "%u %u", &request_size, &response_size)) {
+	case 1:
+		response_size = request_size;
+		break;
+	case 2:
+		break;
+	default:
+		return -EINVAL;
+	}
+	if (request_size == 0 || response_size == 0)
+		return -EINVAL;
+
+	// Serialized with the callbacks for power management.
+	guard(device)(dev);
+
+	err = ar_context_resize(&ohci->ar_request_ctx, request_size);
+	if (err < 0)
+		return err;
+
+	err = ar_context_resize(&ohci->ar_response_ctx, response_size);
+	if (err < 0)
+		return err;
+
+	return count;
+}
+static DEVICE_ATTR_RW(ar_buffer_size);
+
+static ssize_t ar_overruns_show(struct device *dev, struct device_attribute *attr, char *buf)
+{
+	struct fw_ohci *ohci = pci_get_drvdata(to_pci_dev(dev));
+
+	return sysfs_emit(buf, "%lu %lu\n", READ_ONCE(ohci->ar_request_ctx.overruns),
+			  READ_ONCE(ohci->ar_response_ctx.overruns));
+}
+static DEVICE_ATTR_RO(ar_overruns);
+
+static ssize_t ar_high_watermark_show(struct device *dev, struct device_attribute *attr,
+				      char *buf)
+{
+	struct fw_ohci *ohci = pci_get_drvdata(to_pci_dev(dev));
+
+	return sysfs_emit(buf, "%zu %zu\n", READ_ONCE(ohci->ar_request_ctx.high_watermark),
+			  READ_ONCE(ohci->ar_response_ctx.high_watermark));
+}
+static DEVICE_ATTR_RO(ar_high_watermark);
+
+// Each attribute shows the value of AR request context and AR response context in the order.
+static struct attribute *ohci_attrs[] = {
+	&dev_attr_ar_buffer_size.attr,
+	&dev_attr_ar_overruns.attr,
+	&dev_attr_ar_high_watermark.attr,
+	NULL,
+};
+ATTRIBUTE_GROUPS(ohci);
+
 static struct pci_driver fw_ohci_pci_driver = {
 	.name		= ohci_driver_name,
 	.id_table	= pci_table,
 	.probe		= pci_probe,
 	.remove		= pci_remove,
 	.driver.pm	= &pci_pm_ops,
+	.driver.dev_groups = ohci_groups,
 };
 
 static int __init fw_ohci_init(void)
@@ -72,11 +72,71 @@ static void structure_layout_event_phy_packet2(struct kunit *test)
 	KUNIT_EXPECT_EQ(test, 24, offsetof(struct fw_cdev_event_phy_packet2, data));
 }
 
+// Added at v7.1.
+static void structure_layout_setup_event_ring(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, 16, sizeof(struct fw_cdev_setup_event_ring));
+
+	KUNIT_EXPECT_EQ(test, 0, offsetof(struct fw_cdev_setup_event_ring, size));
+	KUNIT_EXPECT_EQ(test, 4, offsetof(struct fw_cdev_setup_event_ring, data_offset));
+	KUNIT_EXPECT_EQ(test, 8, offsetof(struct fw_cdev_setup_event_ring, mmap_offset));
+}
+
+// Added at v7.1.
+static void structure_layout_event_ring_header(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, 128, sizeof(struct fw_cdev_event_ring_header));
+
+	KUNIT_EXPECT_EQ(test, 0, offsetof(struct fw_cdev_event_ring_header, head));
+	KUNIT_EXPECT_EQ(test, 4, offsetof(struct fw_cdev_event_ring_header, overflow));
+	KUNIT_EXPECT_EQ(test, 64, offsetof(struct fw_cdev_event_ring_header, tail));
+}
+
+// Added at v7.1.
+static void structure_layout_event_ring_entry(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, 8, sizeof(struct fw_cdev_event_ring_entry));
+
+	KUNIT_EXPECT_EQ(test, 0, offsetof(struct fw_cdev_event_ring_entry, length));
+	KUNIT_EXPECT_EQ(test, 4, offsetof(struct fw_cdev_event_ring_entry, flags));
+	KUNIT_EXPECT_EQ(test, 8, offsetof(struct fw_cdev_event_ring_entry, data));
+}
+
+// Added at v7.1.
+static void structure_layout_send_requests(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, 16, sizeof(struct fw_cdev_send_requests));
+
+	KUNIT_EXPECT_EQ(test, 0, offsetof(struct fw_cdev_send_requests, requests));
+	KUNIT_EXPECT_EQ(test, 8, offsetof(struct fw_cdev_send_requests, count));
+	KUNIT_EXPECT_EQ(test, 12, offsetof(struct fw_cdev_send_requests, stride));
+}
+
+// Added at v7.1.
+static void structure_layout_run_transaction(struct kunit *test)
+{
+	KUNIT_EXPECT_EQ(test, 48, sizeof(struct fw_cdev_run_transaction));
+
+	KUNIT_EXPECT_EQ(test, 0, offsetof(struct fw_cdev_run_transaction, tcode));
+	KUNIT_EXPECT_EQ(test, 4, offsetof(struct fw_cdev_run_transaction, length));
+	KUNIT_EXPECT_EQ(test, 8, offsetof(struct fw_cdev_run_transaction, offset));
+	KUNIT_EXPECT_EQ(test, 16, offsetof(struct fw_cdev_run_transaction, generation));
+	KUNIT_EXPECT_EQ(test, 20, offsetof(struct fw_cdev_run_transaction, rcode));
+	KUNIT_EXPECT_EQ(test, 24, offsetof(struct fw_cdev_run_transaction, request_tstamp));
+	KUNIT_EXPECT_EQ(test, 28, offsetof(struct fw_cdev_run_transaction, response_tstamp));
+	KUNIT_EXPECT_EQ(test, 32, offsetof(struct fw_cdev_run_transaction, data));
+}
+
 static struct kunit_case structure_layout_test_cases[] = {
 	KUNIT_CASE(structure_layout_event_response),
 	KUNIT_CASE(structure_layout_event_request3),
 	KUNIT_CASE(structure_layout_event_response2),
 	KUNIT_CASE(structure_layout_event_phy_packet2),
+	KUNIT_CASE(structure_layout_setup_event_ring),
+	KUNIT_CASE(structure_layout_event_ring_header),
+	KUNIT_CASE(structure_layout_event_ring_entry),
+	KUNIT_CASE(structure_layout_send_requests),
+	KUNIT_CASE(structure_layout_run_transaction),
 	{}
 };
 
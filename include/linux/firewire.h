@@ -77,8 +77,25 @@ int fw_csr_string(const u32 *directory, int key, char *buf, size_t size);
 
 extern const struct bus_type fw_bus_type;
 
+struct dentry;
 struct fw_card_driver;
+struct fw_iso_demux;
 struct fw_node;
+struct fw_transaction;
+
+// The outstanding transactions to a destination node and the tlabels for them. The lock is per
+// destination, so that the transactions to different nodes do not contend with each other.
+struct fw_transaction_pool {
+	spinlock_t lock;
+	int current_tlabel;
+	// The bit for the tlabel is set while it is used, even before the transaction is put on
+	// the table.
+	u64 tlabel_mask;
+	// Indexed by tlabel to match responses.
+	struct fw_transaction *by_tlabel[64];
+	// The number of contended acquisitions of the lock.
+	atomic_long_t contended;
+};
 
 struct fw_card {
 	const struct fw_card_driver *driver;
@@ -91,10 +108,10 @@ struct fw_card {
 	u64 reset_jiffies;
 
 	struct {
-		int current_tlabel;
-		u64 tlabel_mask;
-		struct list_head list;
-		spinlock_t lock;
+		// Indexed by destination phy ID, since tlabel is required to be unique just for the
+		// pair of source and destination.
+		struct fw_transaction_pool pools[64];
+		wait_queue_head_t tlabel_wait;
 	} transactions;
 
 	struct {
@@ -145,7 +162,14 @@ struct fw_card {
 	__be32 maint_utility_register;
 
 	struct workqueue_struct *isoc_wq;
+	struct workqueue_struct *isoc_percpu_wq;
 	struct workqueue_struct *async_wq;
+
+	// The directory in debugfs for the card. The driver can add its own entries to it.
+	struct dentry *debugfs_dir;
+
+	// The multichannel IR context shared by consumers of isochronous packets.
+	struct fw_iso_demux *iso_demux;
 };
 
 static inline struct fw_card *fw_card_get(struct fw_card *card)
@@ -163,6 +187,7 @@ static inline void fw_card_put(struct fw_card *card)
 }
 
 int fw_card_read_cycle_time(struct fw_card *card, u32 *cycle_time);
+int fw_card_read_cycle_time_precise(struct fw_card *card, u32 *cycle_time);
 
 struct fw_attribute_group {
 	struct attribute_group *groups[2];
@@ -345,7 +370,7 @@ struct fw_packet {
 struct fw_transaction {
 	int node_id; /* The generation is implied; it is always the current. */
 	int tlabel;
-	struct list_head link;
+	struct list_head link;	/* Only for cancellation. */
 	struct fw_card *card;
 	bool is_split_transaction;
 	struct timer_list split_timeout_timer;
@@ -461,11 +486,133 @@ static inline void fw_send_request_with_tstamp(struct fw_card *card, struct fw_t
 			  length, cb, true, callback_data);
 }
 
+int __fw_queue_request(struct fw_card *card, struct fw_transaction *t, int tcode,
+		int destination_id, int generation, int speed, unsigned long long offset,
+		void *payload, size_t length, union fw_transaction_callback callback,
+		bool with_tstamp, void *callback_data, struct list_head *packets);
+void fw_send_queued_requests(struct fw_card *card, struct list_head *packets);
+
+/**
+ * fw_queue_request() - prepare a request packet for batched submission to generate callback for
+ *			response subaction without time stamp.
+ * @card:		interface to send the request at
+ * @t:			transaction instance to which the request belongs
+ * @tcode:		transaction code
+ * @destination_id:	destination node ID, consisting of bus_ID and phy_ID
+ * @generation:		bus generation in which request and response are valid
+ * @speed:		transmission speed
+ * @offset:		48bit wide offset into destination's address space
+ * @payload:		data payload for the request subaction
+ * @length:		length of the payload, in bytes
+ * @callback:		function to be called when the transaction is completed
+ * @callback_data:	data to be passed to the transaction completion callback
+ * @packets:		list to which the request packet is appended
+ *
+ * A variation of __fw_queue_request() to generate callback for response subaction without time
+ * stamp. The queued requests are submitted by fw_send_queued_requests().
+ *
+ * Return: 0 if queued, or -EBUSY if no tlabel is available.
+ */
+static inline int fw_queue_request(struct fw_card *card, struct fw_transaction *t, int tcode,
+				   int destination_id, int generation, int speed,
+				   unsigned long long offset, void *payload, size_t length,
+				   fw_transaction_callback_t callback, void *callback_data,
+				   struct list_head *packets)
+{
+	union fw_transaction_callback cb = {
+		.without_tstamp = callback,
+	};
+	return __fw_queue_request(card, t, tcode, destination_id, generation, speed, offset,
+				  payload, length, cb, false, callback_data, packets);
+}
+
+/**
+ * fw_queue_request_with_tstamp() - prepare a request packet for batched submission to generate
+ *				    callback for response subaction with time stamp.
+ * @card:		interface to send the request at
+ * @t:			transaction instance to which the request belongs
+ * @tcode:		transaction code
+ * @destination_id:	destination node ID, consisting of bus_ID and phy_ID
+ * @generation:		bus generation in which request and response are valid
+ * @speed:		transmission speed
+ * @offset:		48bit wide offset into destination's address space
+ * @payload:		data payload for the request subaction
+ * @length:		length of the payload, in bytes
+ * @callback:		function to be called when the transaction is completed
+ * @callback_data:	data to be passed to the transaction completion callback
+ * @packets:		list to which the request packet is appended
+ *
+ * A variation of __fw_queue_request() to generate callback for response subaction with time
+ * stamp. The queued requests are submitted by fw_send_queued_requests().
+ *
+ * Return: 0 if queued, or -EBUSY if no tlabel is available.
+ */
+static inline int fw_queue_request_with_tstamp(struct fw_card *card, struct fw_transaction *t,
+	int tcode, int destination_id, int generation, int speed, unsigned long long offset,
+	void *payload, size_t length, fw_transaction_callback_with_tstamp_t callback,
+	void *callback_data, struct list_head *packets)
+{
+	union fw_transaction_callback cb = {
+		.with_tstamp = callback,
+	};
+	return __fw_queue_request(card, t, tcode, destination_id, generation, speed, offset,
+				  payload, length, cb, true, callback_data, packets);
+}
+
 int fw_cancel_transaction(struct fw_card *card,
 			  struct fw_transaction *transaction);
 int fw_run_transaction(struct fw_card *card, int tcode, int destination_id,
 		       int generation, int speed, unsigned long long offset,
 		       void *payload, size_t length);
+
+struct fw_request_batch;
+
+struct fw_batch_request {
+	int tcode;
+	unsigned long long offset;
+	void *payload;
+	size_t length;
+	// The rcode of transaction, filled when the batch is completed.
+	int rcode;
+
+	// Only for core functions.
+	struct fw_transaction transaction;
+	struct fw_request_batch *batch;
+};
+
+typedef void (*fw_request_batch_callback_t)(struct fw_card *card,
+					    struct fw_batch_request *requests,
+					    unsigned int count, void *callback_data);
+
+struct fw_request_batch {
+	// Only for core functions.
+	struct fw_card *card;
+	int destination_id;
+	int generation;
+	int speed;
+	struct fw_batch_request *requests;
+	unsigned int count;
+	unsigned int next;
+	unsigned int inflight;
+	unsigned int completed;
+	bool submitting;
+	bool resubmit;
+	// For the blocking variation. The submission stops instead of failure when the tlabels are
+	// exhausted by the others, then resumes with the tlabel allocated by the waiter.
+	bool may_wait;
+	bool starved;
+	int tlabel;
+	spinlock_t lock;
+	fw_request_batch_callback_t callback;
+	void *callback_data;
+};
+
+void fw_send_request_batch(struct fw_card *card, struct fw_request_batch *batch,
+			   int destination_id, int generation, int speed,
+			   struct fw_batch_request *requests, unsigned int count,
+			   fw_request_batch_callback_t callback, void *callback_data);
+void fw_run_request_batch(struct fw_card *card, int destination_id, int generation, int speed,
+			  struct fw_batch_request *requests, unsigned int count);
 const char *fw_rcode_string(int rcode);
 
 static inline int fw_stream_packet_destination_id(int tag, int channel, int sy)
@@ -527,7 +674,14 @@ struct fw_iso_buffer {
 	enum dma_data_direction direction;
 	struct page **pages;
 	dma_addr_t *dma_addrs;
+	unsigned int *sorted_pages;
 	int page_count;
+	// The number of pages in each physically contiguous chunk, mapped for DMA at once.
+	unsigned int *chunks;
+	int chunk_count;
+	// The index of page next to the end of chunk, per page.
+	unsigned int *chunk_ends;
+	bool need_sync;
 };
 
 int fw_iso_buffer_init(struct fw_iso_buffer *buffer, struct fw_card *card,
@@ -548,6 +702,18 @@ union fw_iso_callback {
 
 enum fw_iso_context_flag {
 	FW_ISO_CONTEXT_FLAG_DROP_OVERFLOW_HEADERS = BIT(0),
+	// The hardware interrupt of the context is masked and the consumer processes completions
+	// by calling fw_iso_context_flush_completions() periodically. The flag should be configured
+	// before starting the context.
+	FW_ISO_CONTEXT_FLAG_POLLING = BIT(1),
+};
+
+// Statistics of FW_ISO_CONTEXT_FLAG_POLLING mode. The driver can expose them in debugfs.
+struct fw_iso_context_poll_stats {
+	u64 polls;		// The number of calls of fw_iso_context_flush_completions().
+	u64 empty_polls;	// The number of the calls retiring no descriptors.
+	u64 retired;		// The total number of retired descriptors.
+	unsigned int max_retired;	// The maximum number of descriptors retired per call.
 };
 
 struct fw_iso_context {
@@ -557,6 +723,17 @@ struct fw_iso_context {
 	int channel;
 	int speed;
 	int flags;
+	int completion_cpu;
+	struct {
+		unsigned int min;
+		unsigned int max;
+	} irq_interval;
+	struct fw_iso_context_poll_stats poll_stats;
+	struct {
+		const struct fw_iso_buffer *buffer;
+		unsigned long start;
+		unsigned long end;
+	} synced_payloads;
 	size_t header_size;
 	size_t header_storage_size;
 	union fw_iso_callback callback;
@@ -572,7 +749,36 @@ int fw_iso_context_queue(struct fw_iso_context *ctx,
 			 struct fw_iso_buffer *buffer,
 			 unsigned long payload);
 void fw_iso_context_queue_flush(struct fw_iso_context *ctx);
+void fw_iso_context_sync_payloads(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+				  unsigned long payload, unsigned long length);
 int fw_iso_context_flush_completions(struct fw_iso_context *ctx);
+int fw_iso_context_set_completion_cpu(struct fw_iso_context *ctx, int cpu);
+int fw_iso_context_reserve_descriptors(struct fw_iso_context *ctx, unsigned int packets,
+				       size_t header_length, size_t payload_length);
+int fw_iso_context_set_irq_interval(struct fw_iso_context *ctx, unsigned int min,
+				    unsigned int max);
+int fw_iso_context_create_ring_program(struct fw_iso_context *ctx, struct fw_iso_buffer *buffer,
+				       unsigned int slots, unsigned int slot_size,
+				       unsigned int irq_interval, int tag);
+int fw_iso_context_update_ring_slot(struct fw_iso_context *ctx, unsigned int index,
+				    unsigned int length);
+
+/**
+ * fw_iso_ring_slot_offset() - the offset of slot in the buffer for the ring program.
+ * @slot_size: the size of slot given to fw_iso_context_create_ring_program()
+ * @index: the index of slot
+ *
+ * The slots are packed in each page so that any slot does not cross the page boundary.
+ *
+ * Return: the offset of slot in the buffer.
+ */
+static inline unsigned long fw_iso_ring_slot_offset(unsigned int slot_size, unsigned int index)
+{
+	unsigned int slots_per_page = PAGE_SIZE / slot_size;
+
+	return (unsigned long)(index / slots_per_page) * PAGE_SIZE +
+	       (index % slots_per_page) * slot_size;
+}
 
 static inline struct fw_iso_context *fw_iso_context_create(struct fw_card *card, int type,
 		int channel, int speed, size_t header_size, fw_iso_callback_t callback,
@@ -605,17 +811,62 @@ static inline struct fw_iso_context *fw_iso_context_create_with_header_storage_s
  * is required to process the context in the current context, fw_iso_context_flush_completions() is
  * available instead.
  *
+ * When the context is steered to a CPU by fw_iso_context_set_completion_cpu(), the work item is
+ * queued to the per-CPU workqueue so that it runs on the CPU as long as it is online. When the CPU
+ * is offline, the work item is queued to the same workqueue on the local CPU, since the work item
+ * still running in one workqueue can be executed in another workqueue concurrently.
+ *
  * Context: Any context.
  */
 static inline void fw_iso_context_schedule_flush_completions(struct fw_iso_context *ctx)
 {
-	queue_work(ctx->card->isoc_wq, &ctx->work);
+	int cpu = READ_ONCE(ctx->completion_cpu);
+
+	if (cpu == WORK_CPU_UNBOUND)
+		queue_work(ctx->card->isoc_wq, &ctx->work);
+	else if (!cpu_online(cpu))
+		queue_work(ctx->card->isoc_percpu_wq, &ctx->work);
+	else
+		queue_work_on(cpu, ctx->card->isoc_percpu_wq, &ctx->work);
 }
 
 int fw_iso_context_start(struct fw_iso_context *ctx,
 			 int cycle, int sync, int tags);
 int fw_iso_context_stop(struct fw_iso_context *ctx);
 void fw_iso_context_destroy(struct fw_iso_context *ctx);
+
+struct fw_iso_demux_consumer;
+
+/**
+ * typedef fw_iso_demux_callback_t - Callback for each isochronous packet in the channel.
+ * @consumer:	the consumer registered for the channel
+ * @header:	the header quadlet of isochronous packet in host byte order
+ * @payload:	the payload of packet in big endian, of the length in @header. It is valid just
+ *		during the call.
+ * @timestamp:	the cycle count when the packet was received, in the same format as the time
+ *		stamp of IR context.
+ */
+typedef void (*fw_iso_demux_callback_t)(struct fw_iso_demux_consumer *consumer, u32 header,
+					const __be32 *payload, u16 timestamp);
+
+/**
+ * struct fw_iso_demux_consumer - Consumer of isochronous packets in a channel.
+ * @channel:		the isochronous channel to receive
+ * @callback:		called for each packet in the channel. It is called in process context
+ *			but should not sleep.
+ * @callback_data:	data available for the callback
+ * @link:		for internal use
+ */
+struct fw_iso_demux_consumer {
+	int channel;
+	fw_iso_demux_callback_t callback;
+	void *callback_data;
+	struct list_head link;
+};
+
+int fw_iso_demux_add_consumer(struct fw_card *card, struct fw_iso_demux_consumer *consumer);
+void fw_iso_demux_remove_consumer(struct fw_card *card, struct fw_iso_demux_consumer *consumer);
+int fw_iso_demux_flush_completions(struct fw_card *card);
 void fw_iso_resource_manage(struct fw_card *card, int generation,
 			    u64 channels_mask, int *channel, int *bandwidth,
 			    bool allocate);
@@ -509,6 +509,12 @@ struct fw_cdev_event_phy_packet2 {
  * sizeof(union fw_cdev_event).  Also note that if you attempt to read(2)
  * an event into a buffer that is not large enough for it, the data that does
  * not fit will be discarded so that the next read(2) will return a new event.
+ *
+ * If the client implements ABI version 7 or later, read(2) returns as many whole events as fit
+ * in the buffer at once. Each event is prefixed by &struct fw_cdev_event_ring_entry, the same as
+ * the record in the ring buffer of events. The first event is truncated as described above if
+ * the buffer is not large enough for it, and &fw_cdev_event_ring_entry.length is the length of
+ * the truncated event. The buffer should be at least 8 bytes.
  */
 union fw_cdev_event {
 	struct fw_cdev_event_common		common;
@@ -562,6 +568,11 @@ union fw_cdev_event {
 /* available since kernel version 3.4 */
 #define FW_CDEV_IOC_FLUSH_ISO           _IOW('#', 0x18, struct fw_cdev_flush_iso)
 
+/* available since kernel version 7.1 */
+#define FW_CDEV_IOC_SETUP_EVENT_RING   _IOWR('#', 0x19, struct fw_cdev_setup_event_ring)
+#define FW_CDEV_IOC_SEND_REQUESTS      _IOWR('#', 0x1a, struct fw_cdev_send_requests)
+#define FW_CDEV_IOC_RUN_TRANSACTION    _IOWR('#', 0x1b, struct fw_cdev_run_transaction)
+
 /*
  * ABI version history
  *  1  (2.6.22)  - initial version
@@ -592,6 +603,14 @@ union fw_cdev_event {
  *                   - %FW_CDEV_EVENT_RESPONSE2
  *                   - %FW_CDEV_EVENT_PHY_PACKET_SENT2
  *                   - %FW_CDEV_EVENT_PHY_PACKET_RECEIVED2
+ *  7  (7.1)     - added %FW_CDEV_IOC_SETUP_EVENT_RING to deliver events via shared memory
+ *               - read(2) returns as many events as fit in the buffer, each of which is
+ *                 prefixed by &struct fw_cdev_event_ring_entry
+ *               - multiple iso contexts per fd, each of which has its own isochronous buffer
+ *                 mapped at the offset computed by %FW_CDEV_ISO_BUFFER_MMAP_STRIDE
+ *               - added %FW_CDEV_IOC_SEND_REQUESTS
+ *               - added %FW_CDEV_IOC_RUN_TRANSACTION
+ *               - added %FW_CDEV_ISO_CONTEXT_POLLING
  */
 
 /**
@@ -652,6 +671,65 @@ struct fw_cdev_send_request {
 	__u32 generation;
 };
 
+/**
+ * struct fw_cdev_send_requests - Send asynchronous request packets at once
+ * @requests:	Userspace pointer to the array of &struct fw_cdev_send_request
+ * @count:	The number of elements in @requests
+ * @stride:	The size of each element in @requests, in bytes. It is
+ *		``sizeof(struct fw_cdev_send_request)`` in user space, which differs
+ *		between ABIs due to the padding at the end of structure.
+ *
+ * The %FW_CDEV_IOC_SEND_REQUESTS ioctl sends the requests in @requests to the device in order,
+ * as %FW_CDEV_IOC_SEND_REQUEST does for each of them. The requests are queued to the controller
+ * at once as many as the transactions can be outstanding, thus their round trips overlap each
+ * other. The kernel writes the response event for each request with its closure, the same as
+ * %FW_CDEV_IOC_SEND_REQUEST.
+ *
+ * The ioctl returns the number of sent requests, and updates @requests and @count to point to
+ * the rest of requests. It can be less than @count when no transaction label is available for
+ * the device, or when any of the requests is invalid. The ioctl fails with errno %EAGAIN if no
+ * request is sent due to the lack of transaction label; the client should retry after receiving
+ * any response event.
+ */
+struct fw_cdev_send_requests {
+	__u64 requests;
+	__u32 count;
+	__u32 stride;
+};
+
+/**
+ * struct fw_cdev_run_transaction - Run an asynchronous transaction synchronously
+ * @tcode:	Transaction code of the request
+ * @length:	Length of payload in @data, in bytes. Both an input parameter (the length of
+ *		outgoing payload) and output parameter (the length of incoming payload).
+ * @offset:	48-bit offset at destination node
+ * @generation:	The bus generation where packet is valid
+ * @rcode:	Output parameter. Response code of the transaction
+ * @request_tstamp: Output parameter. The time stamp of isochronous cycle at which the request
+ *		was sent, in the same format as &fw_cdev_event_response2.request_tstamp.
+ * @response_tstamp: Output parameter. The time stamp of isochronous cycle at which the response
+ *		was sent, in the same format as &fw_cdev_event_response2.response_tstamp.
+ * @data:	The payload of request, and the payload of response when the ioctl returns
+ *
+ * The %FW_CDEV_IOC_RUN_TRANSACTION ioctl sends a request to the device and waits for the
+ * transaction to complete, without generating any event. It is convenient for small register
+ * accesses, such as quadlet read and write, and lock requests up to 16 bytes.
+ *
+ * The ioctl returns when the transaction is completed, including the cases of failure indicated
+ * by @rcode; e.g. %RCODE_SEND_ERROR if the request can not be sent, %RCODE_CANCELLED at bus reset
+ * or when the waiting process is killed.
+ */
+struct fw_cdev_run_transaction {
+	__u32 tcode;
+	__u32 length;
+	__u64 offset;
+	__u32 generation;
+	__u32 rcode;
+	__u32 request_tstamp;
+	__u32 response_tstamp;
+	__u32 data[4];
+};
+
 /**
  * struct fw_cdev_send_response - Send an asynchronous response packet
  * @rcode:	Response code as determined by the userspace handler
@@ -800,10 +878,13 @@ struct fw_cdev_remove_descriptor {
 #define FW_CDEV_ISO_CONTEXT_RECEIVE			1
 #define FW_CDEV_ISO_CONTEXT_RECEIVE_MULTICHANNEL	2 /* added in 2.6.36 */
 
+#define FW_CDEV_ISO_CONTEXT_POLLING			0x00010000 /* added in 7.1 */
+
 /**
  * struct fw_cdev_create_iso_context - Create a context for isochronous I/O
  * @type:	%FW_CDEV_ISO_CONTEXT_TRANSMIT or %FW_CDEV_ISO_CONTEXT_RECEIVE or
- *		%FW_CDEV_ISO_CONTEXT_RECEIVE_MULTICHANNEL
+ *		%FW_CDEV_ISO_CONTEXT_RECEIVE_MULTICHANNEL, optionally bitwise-ORed with
+ *		%FW_CDEV_ISO_CONTEXT_POLLING
  * @header_size: Header size to strip in single-channel reception
  * @channel:	Channel to bind to in single-channel reception or transmission
  * @speed:	Transmission speed
@@ -825,11 +906,23 @@ struct fw_cdev_remove_descriptor {
  *
  * @speed is ignored in receive context types.
  *
+ * If %FW_CDEV_ISO_CONTEXT_POLLING is given in @type, the hardware interrupt for the context is
+ * not enabled when it is started. Instead, the client is expected to call
+ * %FW_CDEV_IOC_FLUSH_ISO periodically to process the completed packets. It is available since ABI
+ * version 7.
+ *
  * If a context was successfully created, the kernel writes back a handle to the
  * context, which must be passed in for subsequent operations on that context.
  *
+ * The isochronous buffer for the context is mapped by mmap(2) at the offset of @handle multiplied
+ * by %FW_CDEV_ISO_BUFFER_MMAP_STRIDE. The handle is the lowest one of which the context is not
+ * created yet, thus the buffer can be mapped in advance of the creation as well. The events for
+ * the context are distinguished by @closure. Before ABI version 7, the offset is ignored and the
+ * buffer is always for the single context.
+ *
  * Limitations:
- * No more than one iso context can be created per fd.
+ * Since ABI version 7, up to 64 iso contexts can be created per fd. Before, no more than one iso
+ * context can be created per fd.
  * The total number of contexts that all userspace and kernelspace drivers can
  * create on a card at a time is a hardware limit, typically 4 or 8 contexts per
  * direction, and of them at most one multichannel receive context.
@@ -843,6 +936,8 @@ struct fw_cdev_create_iso_context {
 	__u32 handle;
 };
 
+#define FW_CDEV_ISO_BUFFER_MMAP_STRIDE	0x01000000
+
 /**
  * struct fw_cdev_set_iso_channels - Select channels in multichannel reception
  * @channels:	Bitmask of channels to listen to
@@ -1015,6 +1110,10 @@ struct fw_cdev_stop_iso {
  * Any %FW_CDEV_EVENT_ISO_INTERRUPT or %FW_CDEV_EVENT_ISO_INTERRUPT_MULTICHANNEL
  * events generated by this ioctl are sent synchronously, i.e., are available
  * for reading from the file descriptor when this ioctl returns.
+ *
+ * For contexts created with %FW_CDEV_ISO_CONTEXT_POLLING, this ioctl is the
+ * only way to process completed packets, since no hardware interrupt is
+ * generated for them.
  */
 struct fw_cdev_flush_iso {
 	__u32 handle;
@@ -1175,6 +1274,73 @@ struct fw_cdev_receive_phy_packets {
 	__u64 closure;
 };
 
+/**
+ * struct fw_cdev_setup_event_ring - Set up the ring buffer of events in shared memory
+ * @size:	Size of the data area of the ring in bytes. It should be power of 2, and between
+ *		4096 and 16 MiB.
+ * @data_offset: Output parameter. Offset of the data area from the start of the mapping
+ * @mmap_offset: Output parameter. Offset to be passed to mmap(2) to map the ring
+ *
+ * The %FW_CDEV_IOC_SETUP_EVENT_RING ioctl allocates the ring buffer in which the kernel writes
+ * events subsequently generated for the client, instead of queueing them to be read(2). The ring
+ * is mapped by mmap(2) with @mmap_offset and the length of @data_offset plus @size, and with
+ * ``PROT_READ | PROT_WRITE`` and ``MAP_SHARED``. The mapping starts with
+ * &struct fw_cdev_event_ring_header, followed by the data area at @data_offset.
+ *
+ * The ring can be set up just once for the client. The events generated before the ring was set
+ * up are still available by read(2).
+ */
+struct fw_cdev_setup_event_ring {
+	__u32 size;
+	__u32 data_offset;
+	__u64 mmap_offset;
+};
+
+/**
+ * struct fw_cdev_event_ring_header - The header of ring buffer of events
+ * @head:	Producer index, written by the kernel
+ * @overflow:	The number of events which did not fit in the ring, written by the kernel
+ * @reserved0:	Reserved so that @tail is in the other cache line
+ * @tail:	Consumer index, written by the client
+ * @reserved1:	Reserved
+ *
+ * @head and @tail are free-running counters in bytes. The position in the data area is the
+ * counter modulo &fw_cdev_setup_event_ring.size. The data area between @tail and @head contains
+ * records of &struct fw_cdev_event_ring_entry. The client should read @head with acquire
+ * semantics, consume the records, then write @tail with release semantics.
+ *
+ * When the free space of the ring is not enough for a new event, the event and the subsequent
+ * ones are queued to be read(2) as usual until the queue becomes empty, and @overflow is
+ * incremented for each of them. It is a hint for the client to drain the queue by read(2), or
+ * to consume the ring faster. No event is lost.
+ */
+struct fw_cdev_event_ring_header {
+	__u32 head;
+	__u32 overflow;
+	__u32 reserved0[14];
+	__u32 tail;
+	__u32 reserved1[15];
+};
+
+#define FW_CDEV_EVENT_RING_ENTRY_PADDING	0x00000001
+
+/**
+ * struct fw_cdev_event_ring_entry - A record in ring buffer of events, or in buffer of read(2)
+ * @length:	Length of @data in bytes
+ * @flags:	%FW_CDEV_EVENT_RING_ENTRY_PADDING if the record just fills the rest of the data
+ *		area, and the next record is at the start of the data area
+ * @data:	The event, the same as the one read(2) by the client. It can be casted to
+ *		&union fw_cdev_event.
+ *
+ * The record is aligned to 8 bytes. The next record follows at the offset of 8 bytes plus
+ * @length rounded up to multiple of 8.
+ */
+struct fw_cdev_event_ring_entry {
+	__u32 length;
+	__u32 flags;
+	__u64 data[];
+};
+
 #define FW_CDEV_VERSION 3 /* Meaningless legacy macro; don't use it. */
 
 #endif /* _LINUX_FIREWIRE_CDEV_H */